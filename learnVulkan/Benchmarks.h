@@ -0,0 +1,490 @@
+#pragma once
+
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <vulkan/vulkan_core.h>
+#include "CustomQueueUtils.h"
+#include "MemoryAllocator.h"
+#include "BufferUtils.h"
+#include "StagingRing.h"
+#include "TransferUploader.h"
+#include "FrameCommandPool.h"
+#include "JobSystem.h"
+#include "Culling.h"
+#include "PipelineCompiler.h"
+#include "PipelineRegistry.h"
+
+namespace Benchmarks {
+	using Clock = std::chrono::high_resolution_clock;
+
+	static double millisecondsSince(Clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	// mesh-sized buffers, deterministic so runs are comparable across commits
+	static std::vector<VkDeviceSize> makeBufferSizes(uint32_t count) {
+		const VkDeviceSize sizes[] = { 256, 512, 1024, 2048, 4096 };
+		std::vector<VkDeviceSize> ret(count);
+		uint32_t seed = 12345;
+		for (auto& size : ret) {
+			seed = seed * 1664525u + 1013904223u;
+			size = sizes[(seed >> 16) % 5];
+		}
+		return ret;
+	}
+
+	// Creates and destroys bufferCount device-local buffers, once with one vkAllocateMemory per buffer
+	// (the old createBuffer path) and once through the block allocator.
+	void runBufferAllocationBenchmark(VkDevice device, VkPhysicalDevice physicalDevice, QueueFamilyIndices queueFamilyIndices, DeviceMemoryAllocator& allocator, uint32_t bufferCount = 100000) {
+		auto sizes = makeBufferSizes(bufferCount);
+		const VkBufferUsageFlags usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+		uint32_t queueFamilies[] = { queueFamilyIndices.graphicsFamily.value(), queueFamilyIndices.transferFamily.value() };
+
+		VkBufferCreateInfo bufferInfo{};
+		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+		bufferInfo.usage = usage;
+		bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+		bufferInfo.queueFamilyIndexCount = 2;
+		bufferInfo.pQueueFamilyIndices = queueFamilies;
+
+		// the direct path can't hold more than maxMemoryAllocationCount at once, so it runs in batches
+		VkPhysicalDeviceProperties deviceProperties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+		uint32_t batchSize = std::min(bufferCount, deviceProperties.limits.maxMemoryAllocationCount - 64);
+
+		std::vector<VkBuffer> buffers(bufferCount);
+		std::vector<VkDeviceMemory> memories(batchSize);
+		double directAllocMs = 0.0, directFreeMs = 0.0;
+		for (uint32_t first = 0; first < bufferCount; first += batchSize) {
+			uint32_t count = std::min(batchSize, bufferCount - first);
+			auto start = Clock::now();
+			for (uint32_t i = 0; i < count; i++) {
+				bufferInfo.size = sizes[first + i];
+				if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffers[i]) != VK_SUCCESS) {
+					throw std::runtime_error("benchmark: failed to create buffer");
+				}
+				VkMemoryRequirements memRequirements;
+				vkGetBufferMemoryRequirements(device, buffers[i], &memRequirements);
+
+				VkMemoryAllocateInfo allocInfo{};
+				allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+				allocInfo.allocationSize = memRequirements.size;
+				allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, allocator.getMemoryTypes().getProperties());
+				if (vkAllocateMemory(device, &allocInfo, nullptr, &memories[i]) != VK_SUCCESS) {
+					throw std::runtime_error("benchmark: failed to allocate buffer memory");
+				}
+				vkBindBufferMemory(device, buffers[i], memories[i], 0);
+			}
+			directAllocMs += millisecondsSince(start);
+
+			start = Clock::now();
+			for (uint32_t i = 0; i < count; i++) {
+				vkDestroyBuffer(device, buffers[i], nullptr);
+				vkFreeMemory(device, memories[i], nullptr);
+			}
+			directFreeMs += millisecondsSince(start);
+		}
+
+		std::vector<MemoryAllocation> allocations(bufferCount);
+		auto start = Clock::now();
+		for (uint32_t i = 0; i < bufferCount; i++) {
+			createBuffer(sizes[i], usage, MemoryUsage::GpuOnly, buffers[i], allocations[i], device, allocator);
+		}
+		double blockAllocMs = millisecondsSince(start);
+
+		// free every other buffer first so the stats show a worst-case interleaved hole pattern
+		start = Clock::now();
+		for (uint32_t i = 0; i < bufferCount; i += 2) {
+			destroyBuffer(buffers[i], allocations[i], device, allocator);
+		}
+		double halfFreeMs = millisecondsSince(start);
+		std::cout << "allocator stats with every other buffer freed:\n";
+		allocator.printStats(std::cout);
+
+		start = Clock::now();
+		for (uint32_t i = 1; i < bufferCount; i += 2) {
+			destroyBuffer(buffers[i], allocations[i], device, allocator);
+		}
+		double blockFreeMs = halfFreeMs + millisecondsSince(start);
+
+		std::cout << "buffer allocation benchmark, " << bufferCount << " buffers\n"
+			<< "  vkAllocateMemory per buffer: alloc " << directAllocMs << " ms, free " << directFreeMs << " ms (batches of " << batchSize << ")\n"
+			<< "  block allocator:             alloc " << blockAllocMs << " ms, free " << blockFreeMs << " ms\n";
+		allocator.printStats(std::cout);
+	}
+
+	// Uploads meshCount meshes of meshSize bytes into one device-local buffer, once through a temporary
+	// HOST_VISIBLE buffer and a submit per upload (create, map, memcpy, unmap, copy, wait, destroy) and once
+	// through the staging ring and batched transfer submits.
+	void runStagingBenchmark(VkDevice device, DeviceMemoryAllocator& allocator, StagingRing& stagingRing, TransferUploader& uploader, VkCommandPool transferCommandPool, VkQueue transferQueue, uint32_t meshCount = 2000, VkDeviceSize meshSize = 64 * 1024) {
+		std::vector<char> mesh(meshSize);
+		for (size_t i = 0; i < mesh.size(); i++) {
+			mesh[i] = static_cast<char>(i * 31);
+		}
+
+		VkBuffer dstBuffer;
+		MemoryAllocation dstAllocation;
+		createBuffer(meshCount * meshSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, MemoryUsage::GpuOnly, dstBuffer, dstAllocation, device, allocator);
+
+		auto start = Clock::now();
+		for (uint32_t i = 0; i < meshCount; i++) {
+			VkBuffer tempBuffer;
+			VkDeviceMemory tempBufferMemory;
+			VkBufferCreateInfo bufferInfo{};
+			bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+			bufferInfo.size = meshSize;
+			bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+			bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			if (vkCreateBuffer(device, &bufferInfo, nullptr, &tempBuffer) != VK_SUCCESS) {
+				throw std::runtime_error("benchmark: failed to create staging buffer");
+			}
+			VkMemoryRequirements memRequirements;
+			vkGetBufferMemoryRequirements(device, tempBuffer, &memRequirements);
+
+			VkMemoryAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+			allocInfo.allocationSize = memRequirements.size;
+			allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, allocator.getMemoryTypes().getProperties());
+			if (vkAllocateMemory(device, &allocInfo, nullptr, &tempBufferMemory) != VK_SUCCESS) {
+				throw std::runtime_error("benchmark: failed to allocate staging memory");
+			}
+			vkBindBufferMemory(device, tempBuffer, tempBufferMemory, 0);
+
+			void* data;
+			vkMapMemory(device, tempBufferMemory, 0, meshSize, 0, &data);
+			memcpy(data, mesh.data(), (size_t)meshSize);
+			vkUnmapMemory(device, tempBufferMemory);
+
+			copyBuffer(tempBuffer, 0, dstBuffer, i * meshSize, meshSize, transferCommandPool, transferQueue, device);
+
+			vkDestroyBuffer(device, tempBuffer, nullptr);
+			vkFreeMemory(device, tempBufferMemory, nullptr);
+		}
+		double tempBufferMs = millisecondsSince(start);
+
+		StagingStats before = stagingRing.getStats();
+		uint64_t submitsBefore = uploader.getStats().submits;
+		start = Clock::now();
+		UploadTicket ticket{};
+		for (uint32_t i = 0; i < meshCount; i++) {
+			ticket = uploader.upload(dstBuffer, i * meshSize, mesh.data(), meshSize);
+		}
+		uploader.wait(ticket);
+		uploader.discardAcquires(dstBuffer);
+		double ringMs = millisecondsSince(start);
+		StagingStats ringStats;
+		ringStats.bytesStaged = stagingRing.getStats().bytesStaged - before.bytesStaged;
+		ringStats.stageSeconds = stagingRing.getStats().stageSeconds - before.stageSeconds;
+		ringStats.regionWaits = stagingRing.getStats().regionWaits - before.regionWaits;
+		uint64_t ringSubmits = uploader.getStats().submits - submitsBefore;
+
+		destroyBuffer(dstBuffer, dstAllocation, device, allocator);
+
+		double megabytes = meshCount * meshSize / (1024.0 * 1024.0);
+		std::cout << "staging benchmark, " << meshCount << " uploads of " << meshSize << " bytes\n"
+			<< "  temporary buffer per upload: " << megabytes / (tempBufferMs / 1000.0) << " MB/s end to end, " << meshCount << " submits\n"
+			<< "  staging ring, batched:       " << megabytes / (ringMs / 1000.0) << " MB/s end to end, " << ringSubmits << " submits, "
+			<< ringStats.megabytesPerSecond() << " MB/s into the ring, "
+			<< ringStats.regionWaits << " region waits\n";
+	}
+
+	// Issues uploadCount uploads back to back into distinct ranges of one buffer. The batch fits into a
+	// single ring region, so none of the calls may wait on the host; returns false if one did.
+	bool runUploadStallCheck(VkDevice device, DeviceMemoryAllocator& allocator, StagingRing& stagingRing, TransferUploader& uploader, uint32_t uploadCount = 1000, VkDeviceSize uploadSize = 4096) {
+		if (uploadCount * uploadSize > stagingRing.getRegionSize()) {
+			throw std::runtime_error("upload check: batch must fit in one staging region");
+		}
+		std::vector<char> data(uploadSize, 0x5a);
+
+		VkBuffer dstBuffer;
+		MemoryAllocation dstAllocation;
+		createBuffer(uploadCount * uploadSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, MemoryUsage::GpuOnly, dstBuffer, dstAllocation, device, allocator);
+
+		// start on a fresh region so a partially filled one can't force a wrap half way through
+		uploader.endFrame();
+		uint32_t waitsBefore = stagingRing.getStats().regionWaits;
+
+		double worstCallMs = 0.0, totalMs = 0.0;
+		UploadTicket previous{};
+		bool ticketsOrdered = true;
+		for (uint32_t i = 0; i < uploadCount; i++) {
+			auto start = Clock::now();
+			UploadTicket ticket = uploader.upload(dstBuffer, i * uploadSize, data.data(), uploadSize);
+			double callMs = millisecondsSince(start);
+			worstCallMs = std::max(worstCallMs, callMs);
+			totalMs += callMs;
+			ticketsOrdered = ticketsOrdered && ticket.value >= previous.value;
+			previous = ticket;
+		}
+		uint32_t hostWaits = stagingRing.getStats().regionWaits - waitsBefore;
+
+		uploader.wait(previous);
+		uploader.discardAcquires(dstBuffer);
+		destroyBuffer(dstBuffer, dstAllocation, device, allocator);
+
+		bool ok = hostWaits == 0 && ticketsOrdered;
+		std::cout << "upload stall check, " << uploadCount << " uploads of " << uploadSize << " bytes: "
+			<< totalMs << " ms issuing, worst call " << worstCallMs << " ms, " << hostWaits << " host waits, "
+			<< (ok ? "PASS" : "FAIL") << '\n';
+		return ok;
+	}
+
+	// Load time for large meshes, staged through the transfer queue versus written straight into mapped
+	// memory. Times run until the data is usable by the GPU. The direct path only lands in device local
+	// memory on unified memory; on a discrete GPU it measures writes into host memory instead.
+	void runGeometryUploadBenchmark(VkDevice device, DeviceMemoryAllocator& allocator, TransferUploader& uploader, uint32_t meshCount = 8, VkDeviceSize meshSize = 32 * 1024 * 1024) {
+		std::vector<char> mesh(meshSize);
+		for (size_t i = 0; i < mesh.size(); i++) {
+			mesh[i] = static_cast<char>(i * 31);
+		}
+
+		std::vector<VkBuffer> buffers(meshCount);
+		std::vector<MemoryAllocation> allocations(meshCount);
+		double loadMs[2] = {};
+		for (int direct = 0; direct < 2; direct++) {
+			auto start = Clock::now();
+			UploadTicket ticket{};
+			for (uint32_t i = 0; i < meshCount; i++) {
+				ticket = createGeometryBuffer(meshSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, mesh.data(), direct == 1, buffers[i], allocations[i], device, allocator, uploader);
+			}
+			uploader.wait(ticket);
+			loadMs[direct] = millisecondsSince(start);
+
+			for (uint32_t i = 0; i < meshCount; i++) {
+				uploader.discardAcquires(buffers[i]);
+				destroyBuffer(buffers[i], allocations[i], device, allocator);
+			}
+		}
+
+		double megabytes = meshCount * meshSize / (1024.0 * 1024.0);
+		std::cout << "geometry upload benchmark, " << meshCount << " meshes of " << meshSize << " bytes"
+			<< (allocator.getMemoryTypes().isUnifiedMemory() ? " (unified memory)" : " (discrete, direct path writes host memory)") << '\n'
+			<< "  staged:        " << loadMs[0] << " ms, " << megabytes / (loadMs[0] / 1000.0) << " MB/s\n"
+			<< "  direct writes: " << loadMs[1] << " ms, " << megabytes / (loadMs[1] / 1000.0) << " MB/s\n";
+	}
+
+	// CPU cost of recycling and re-recording a frame's command buffers, once resetting every buffer on its own
+	// and once resetting each frame slot's pool as a whole. Nothing is submitted, so a slot can be recycled
+	// as soon as it comes round; this isolates the reset and allocation cost from any GPU waits.
+	void runCommandPoolBenchmark(VkDevice device, QueueFamilyIndices queueFamilyIndices, const VkAllocationCallbacks* allocationCallbacks, uint32_t frameCount = 1000, uint32_t buffersPerFrame = 64, uint32_t slotCount = 3) {
+		VkMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+		double frameMs[2] = {};
+		for (int perFramePool = 0; perFramePool < 2; perFramePool++) {
+			std::vector<FrameCommandPool> pools(slotCount);
+			for (auto& pool : pools) {
+				pool.init(device, queueFamilyIndices.graphicsFamily.value(), perFramePool == 0, true, allocationCallbacks);
+			}
+
+			auto start = Clock::now();
+			for (uint32_t frame = 0; frame < frameCount; frame++) {
+				FrameCommandPool& pool = pools[frame % slotCount];
+				pool.reset();
+				for (uint32_t i = 0; i < buffersPerFrame; i++) {
+					VkCommandBuffer commandBuffer = i == 0 ? pool.allocatePrimary() : pool.allocateSecondary();
+					VkCommandBufferInheritanceInfo inheritanceInfo{};
+					inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+					VkCommandBufferBeginInfo beginInfo{};
+					beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+					beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+					beginInfo.pInheritanceInfo = i == 0 ? nullptr : &inheritanceInfo;
+					if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+						throw std::runtime_error("failed to begin recording command buffer!");
+					}
+					vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+					if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+						throw std::runtime_error("failed to record command buffer!");
+					}
+				}
+			}
+			frameMs[perFramePool] = millisecondsSince(start) / frameCount;
+
+			for (auto& pool : pools) {
+				pool.destroy();
+			}
+		}
+
+		std::cout << "command pool benchmark, " << frameCount << " frames of " << buffersPerFrame << " command buffers over " << slotCount << " slots\n"
+			<< "  per buffer reset:     " << frameMs[0] << " ms per frame\n"
+			<< "  per frame pool reset: " << frameMs[1] << " ms per frame\n";
+	}
+
+	// CPU side of a frame on the job system with 1 to maxThreads workers: object transforms and frustum culling
+	// as parallel_for jobs, followed by a job depending on both that walks the visible set the way recording
+	// does. Runs without the GPU, so it shows how the scheduler itself scales.
+	void runJobScalingBenchmark(uint32_t maxThreads, uint32_t objectCount = 100000, uint32_t frameCount = 200) {
+		const uint32_t grainSize = 1024;
+		glm::mat4 viewProj = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 10.0f)
+			* glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+		Frustum frustum = Frustum::fromMatrix(viewProj);
+		uint32_t gridSide = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(objectCount))));
+		float cellSize = 2.0f / gridSide;
+		auto placement = [=](uint32_t i) {
+			glm::vec3 cellCenter((i % gridSide + 0.5f) * cellSize - 1.0f, (i / gridSide + 0.5f) * cellSize - 1.0f, 0.0f);
+			return glm::scale(glm::translate(glm::mat4(1.0f), cellCenter), glm::vec3(cellSize * 0.8f));
+		};
+
+		std::vector<glm::mat4> models(objectCount);
+		std::vector<uint8_t> visible(objectCount);
+		std::cout << "job scaling benchmark, " << objectCount << " objects, " << frameCount << " frames\n";
+		double singleThreadMs = 0.0;
+		for (uint32_t threadCount = 1; threadCount <= maxThreads; threadCount++) {
+			JobSystem jobs;
+			jobs.init(threadCount);
+			uint64_t visibleTotal = 0;
+			auto runFrame = [&](uint32_t frame) {
+				float time = frame / 60.0f;
+				JobHandle transforms = jobs.submit([&, time]() {
+					jobs.parallelFor(objectCount, grainSize, [&, time](uint32_t begin, uint32_t end) {
+						for (uint32_t i = begin; i < end; i++) {
+							models[i] = glm::rotate(placement(i), (time + i * 0.01f) * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+						}
+					});
+				});
+				JobHandle culling = jobs.submit([&]() {
+					jobs.parallelFor(objectCount, grainSize, [&](uint32_t begin, uint32_t end) {
+						for (uint32_t i = begin; i < end; i++) {
+							glm::mat4 cell = placement(i);
+							float radius = glm::length(glm::vec3(cell * glm::vec4(0.5f, 0.5f, 0.0f, 0.0f)));
+							visible[i] = frustum.intersectsSphere(glm::vec3(cell[3]), radius) ? 1 : 0;
+						}
+					});
+				});
+				JobHandle recording = jobs.submit([&]() {
+					for (uint32_t i = 0; i < objectCount; i++) {
+						visibleTotal += visible[i];
+					}
+				}, { transforms, culling });
+				jobs.wait({ transforms, culling, recording });
+			};
+
+			for (uint32_t frame = 0; frame < 10; frame++) {
+				runFrame(frame);
+			}
+			auto start = Clock::now();
+			for (uint32_t frame = 0; frame < frameCount; frame++) {
+				runFrame(frame);
+			}
+			double frameMs = millisecondsSince(start) / frameCount;
+			jobs.destroy();
+
+			if (threadCount == 1) singleThreadMs = frameMs;
+			double speedup = singleThreadMs / frameMs;
+			std::cout << "  " << threadCount << " threads: " << frameMs << " ms per frame, speedup " << speedup
+				<< ", efficiency " << speedup / threadCount * 100.0 << "%, " << visibleTotal / (frameCount + 10) << " visible\n";
+		}
+	}
+
+	// Permutations of the scene pipeline in the fixed-function state materials would vary; 480 distinct ones
+	// before they repeat.
+	static std::vector<PipelineDescription> makePipelinePermutations(const PipelineDescription& base, uint32_t count) {
+		const VkCullModeFlags cullModes[] = { VK_CULL_MODE_NONE, VK_CULL_MODE_FRONT_BIT, VK_CULL_MODE_BACK_BIT, VK_CULL_MODE_FRONT_AND_BACK };
+		std::vector<PipelineDescription> ret(count, base);
+		for (uint32_t i = 0; i < count; i++) {
+			ret[i].cullMode = cullModes[i % 4];
+			ret[i].frontFace = (i / 4) % 2 ? VK_FRONT_FACE_COUNTER_CLOCKWISE : VK_FRONT_FACE_CLOCKWISE;
+			ret[i].blendEnable = (i / 8) % 2 == 1;
+			ret[i].topology = (i / 16) % 2 ? VK_PRIMITIVE_TOPOLOGY_TRIANGLE_STRIP : VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+			ret[i].colorWriteMask = 1 + (i / 32) % 15;
+		}
+		return ret;
+	}
+
+	// Compiles pipelineCount permutations through PipelineCompiler with 1 to maxThreads workers, each round into a
+	// fresh, empty VkPipelineCache. Drivers that keep their own shader cache on disk answer later rounds from it,
+	// so it should be disabled for these numbers to mean compile time. A last round asks a PipelineRegistry for
+	// the same permutations with the device's optional features, which leave fewer and cheaper compiles.
+	void runPipelineCompileBenchmark(VkDevice device, const PipelineDescription& base, uint32_t pipelineCount, uint32_t maxThreads,
+		const PipelineFeatures& features, const VkAllocationCallbacks* allocationCallbacks) {
+		std::vector<PipelineDescription> permutations = makePipelinePermutations(base, pipelineCount);
+		std::cout << "pipeline compile benchmark, " << pipelineCount << " pipelines (disable the driver's shader disk cache for compile-bound numbers)\n";
+		double singleThreadMs = 0.0;
+		for (uint32_t threadCount = 1; threadCount <= maxThreads; threadCount++) {
+			VkPipelineCacheCreateInfo cacheInfo{};
+			cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+			VkPipelineCache cache;
+			if (vkCreatePipelineCache(device, &cacheInfo, allocationCallbacks, &cache) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create pipeline cache!");
+			}
+			JobSystem jobs;
+			jobs.init(threadCount);
+			PipelineCompiler compiler;
+			compiler.init(jobs, device, cache, PipelineFeatures{}, allocationCallbacks);
+
+			auto start = Clock::now();
+			std::vector<PipelineFuture> futures;
+			futures.reserve(pipelineCount);
+			for (const auto& description : permutations) {
+				futures.push_back(compiler.compile(description));
+			}
+			std::vector<VkPipeline> pipelines;
+			double compileMs = 0.0;
+			for (const auto& future : futures) {
+				pipelines.push_back(compiler.wait(future));
+				compileMs += future.result->compileMs;
+			}
+			double totalMs = millisecondsSince(start);
+
+			for (VkPipeline pipeline : pipelines) {
+				vkDestroyPipeline(device, pipeline, allocationCallbacks);
+			}
+			compiler.destroy();
+			jobs.destroy();
+			vkDestroyPipelineCache(device, cache, allocationCallbacks);
+
+			if (threadCount == 1) singleThreadMs = totalMs;
+			std::cout << "  " << threadCount << " threads: " << totalMs << " ms, " << pipelineCount / (totalMs / 1000.0) << " pipelines/s, "
+				<< compileMs / pipelineCount << " ms per pipeline, speedup " << singleThreadMs / totalMs << '\n';
+		}
+
+		VkPipelineCacheCreateInfo cacheInfo{};
+		cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		VkPipelineCache cache;
+		if (vkCreatePipelineCache(device, &cacheInfo, allocationCallbacks, &cache) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create pipeline cache!");
+		}
+		// prefetched pipelines compile on the background threads
+		JobSystem jobs;
+		jobs.init(maxThreads, maxThreads);
+		PipelineCompiler compiler;
+		compiler.init(jobs, device, cache, features, allocationCallbacks);
+		PipelineRegistry registry;
+		registry.init(compiler, device, allocationCallbacks);
+
+		auto start = Clock::now();
+		std::vector<PipelineId> ids;
+		for (const auto& description : permutations) {
+			ids.push_back(registry.request(description));
+		}
+		for (PipelineId id : ids) {
+			registry.prefetch(id);
+		}
+		for (PipelineId id : ids) {
+			registry.get(id);
+		}
+		double totalMs = millisecondsSince(start);
+		PipelineRegistryStats stats = registry.getStats();
+
+		registry.destroy();
+		compiler.destroy();
+		jobs.destroy();
+		vkDestroyPipelineCache(device, cache, allocationCallbacks);
+		std::cout << "  registry, " << maxThreads << " threads, " << (features.graphicsPipelineLibrary ? "pipeline libraries" : "monolithic")
+			<< (features.extendedDynamicState || features.extendedDynamicState2 || features.dynamicBlend ? " with extended dynamic state: " : ": ")
+			<< stats.unique << " pipelines";
+		if (features.graphicsPipelineLibrary) {
+			std::cout << " linked from " << stats.libraries << " libraries";
+		}
+		std::cout << ", " << totalMs << " ms\n";
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include <vulkan/vulkan_core.h>
+
+// Everything the static draws depend on besides the render pass. The uniform ring hands out the same offsets
+// for the same sequence of pushes into a frame slot, so the slot's first offset stands in for all of them.
+struct StaticCommandKey {
+	uint64_t sceneVersion = 0;
+	VkExtent2D extent{};
+	// changes whenever a pipeline the draws may bind is created
+	uint64_t pipelineVersion = 0;
+	uint32_t uniformBase = 0;
+
+	bool operator==(const StaticCommandKey& other) const {
+		return sceneVersion == other.sceneVersion && extent.width == other.extent.width && extent.height == other.extent.height
+			&& pipelineVersion == other.pipelineVersion && uniformBase == other.uniformBase;
+	}
+};
+
+struct CommandCacheStats {
+	uint64_t hits = 0;
+	uint64_t misses = 0;
+};
+
+// Remembers, per frame slot, the secondaries the static draws were last recorded into and under which key,
+// so they can be executed again as long as the key matches. The buffers themselves belong to the recorder's
+// static channel; they are only re-recorded after a miss, once the frame that last used the slot has retired.
+class SceneCommandCache {
+public:
+	void init(uint32_t slotCount) {
+		entries.assign(slotCount, Entry{});
+	}
+
+	bool lookupStatic(uint32_t slot, const StaticCommandKey& key, std::vector<VkCommandBuffer>& commandBuffers) {
+		Entry& entry = entries[slot];
+		if (entry.valid && entry.key == key) {
+			stats.hits++;
+			commandBuffers = entry.commandBuffers;
+			return true;
+		}
+		stats.misses++;
+		return false;
+	}
+
+	void storeStatic(uint32_t slot, const StaticCommandKey& key, const std::vector<VkCommandBuffer>& commandBuffers) {
+		Entry& entry = entries[slot];
+		entry.valid = true;
+		entry.key = key;
+		entry.commandBuffers = commandBuffers;
+	}
+
+	CommandCacheStats getStats() const {
+		return stats;
+	}
+
+private:
+	struct Entry {
+		bool valid = false;
+		StaticCommandKey key;
+		std::vector<VkCommandBuffer> commandBuffers;
+	};
+
+	std::vector<Entry> entries;
+	CommandCacheStats stats;
+};
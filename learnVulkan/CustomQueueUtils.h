@@ -22,7 +22,7 @@ QueueFamilyIndices findQueueFamliies(VkPhysicalDevice device, VkSurfaceKHR surfa
 	std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
 	vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
 
-	int i = 0;
+	uint32_t i = 0;
 	for (const auto& queueFamily : queueFamilies) {
 		if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
 			indices.graphicsFamily = i;
@@ -30,13 +30,23 @@ QueueFamilyIndices findQueueFamliies(VkPhysicalDevice device, VkSurfaceKHR surfa
 		else if (queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT) {
 			indices.transferFamily = i;
 		}
+		// without a surface (offscreen rendering) nothing is presented and the graphics queue stands in
 		VkBool32 presentSupport = false;
-		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+		if (surface != VK_NULL_HANDLE) {
+			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+		}
+		else {
+			presentSupport = indices.graphicsFamily.has_value() && indices.graphicsFamily.value() == i;
+		}
 		if (presentSupport) {
 			indices.presentFamily = i;
 		}
 		if (indices.isComplete()) break;
 		i++;
 	}
+	// without a dedicated transfer family uploads go through the graphics queue itself
+	if (!indices.transferFamily.has_value()) {
+		indices.transferFamily = indices.graphicsFamily;
+	}
 	return indices;
 }
\ No newline at end of file
@@ -7,11 +7,15 @@
 #include <limits>
 #include <algorithm>
 
+#ifdef _WIN32
 #define VK_USE_PLATFORM_WIN32_KHR
+#endif
 #define GLFW_INCLUDE_VULKAN
 #include "GLFW/glfw3.h"
+#ifdef _WIN32
 #define GLFW_EXPOSE_NATIVE_WIN32
 #include "GLFW/glfw3native.h"
+#endif
 
 
 #include <vulkan/vulkan_raii.hpp>
@@ -60,14 +64,17 @@ VkPresentModeKHR chooseSwapPresentMode(std::vector<VkPresentModeKHR> avaiableMod
 	return bestMode;
 }
 
-VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities, GLFWwindow* window) {
+// without a window (headless surface) the surface takes whatever size it is given, windowlessExtent
+VkExtent2D chooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities, GLFWwindow* window, VkExtent2D windowlessExtent) {
 	//how to avoid windows min/max define
 	if (capabilities.currentExtent.width != (std::numeric_limits<uint32_t>::max)()) {
 		return capabilities.currentExtent;
 	}
 	else {
-		int width, height;
-		glfwGetFramebufferSize(window, &width, &height);
+		int width = static_cast<int>(windowlessExtent.width), height = static_cast<int>(windowlessExtent.height);
+		if (window != nullptr) {
+			glfwGetFramebufferSize(window, &width, &height);
+		}
 
 		VkExtent2D actualExtent = {
 			static_cast<uint32_t>(width),
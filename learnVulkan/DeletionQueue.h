@@ -0,0 +1,40 @@
+#pragma once
+
+#include <deque>
+#include <algorithm>
+#include <functional>
+#include <cstdint>
+
+// Destroy requests tagged with the frame (or timeline value) that may still use the resource. They run once
+// that value is known to be complete, so nothing has to wait for the device to go idle to free a resource.
+// Entries stay sorted by value, so a request can be pushed with a value further ahead than later ones.
+class DeletionQueue {
+public:
+	void push(uint64_t value, std::function<void()> destroy) {
+		auto position = std::upper_bound(entries.begin(), entries.end(), value, [](uint64_t v, const Entry& entry) {
+			return v < entry.first;
+		});
+		entries.emplace(position, value, std::move(destroy));
+	}
+
+	void collect(uint64_t completedValue) {
+		while (!entries.empty() && entries.front().first <= completedValue) {
+			std::function<void()> destroy = std::move(entries.front().second);
+			entries.pop_front();
+			destroy();
+		}
+	}
+
+	// only once the device is idle
+	void flush() {
+		collect(UINT64_MAX);
+	}
+
+	size_t pending() const {
+		return entries.size();
+	}
+
+private:
+	using Entry = std::pair<uint64_t, std::function<void()>>;
+	std::deque<Entry> entries;
+};
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include <vulkan/vulkan_core.h>
+
+// GPU time of each frame's command buffer from a pair of timestamps per frame slot. A slot's results are
+// read back once the frame that wrote them is known to be complete, right before the slot is recorded again.
+class GpuTimer {
+public:
+	void init(VkDevice device, VkPhysicalDevice physicalDevice, uint32_t queueFamily, uint32_t slotCount, const VkAllocationCallbacks* allocationCallbacks) {
+		this->device = device;
+		this->allocationCallbacks = allocationCallbacks;
+
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		uint32_t familyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, nullptr);
+		std::vector<VkQueueFamilyProperties> families(familyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &familyCount, families.data());
+		validBits = families[queueFamily].timestampValidBits;
+		timestampPeriod = properties.limits.timestampPeriod;
+		if (validBits == 0) return;
+
+		VkQueryPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+		poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+		poolInfo.queryCount = slotCount * 2;
+		if (vkCreateQueryPool(device, &poolInfo, allocationCallbacks, &queryPool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create timestamp query pool!");
+		}
+		written.assign(slotCount, false);
+	}
+
+	void destroy() {
+		if (queryPool != VK_NULL_HANDLE) {
+			vkDestroyQueryPool(device, queryPool, allocationCallbacks);
+			queryPool = VK_NULL_HANDLE;
+		}
+		written.clear();
+	}
+
+	bool isSupported() const {
+		return queryPool != VK_NULL_HANDLE;
+	}
+
+	// outside of a render pass, first thing in the command buffer
+	void begin(VkCommandBuffer commandBuffer, uint32_t slot) {
+		if (!isSupported()) return;
+		vkCmdResetQueryPool(commandBuffer, queryPool, slot * 2, 2);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, slot * 2);
+	}
+
+	void end(VkCommandBuffer commandBuffer, uint32_t slot) {
+		if (!isSupported()) return;
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, slot * 2 + 1);
+		written[slot] = true;
+	}
+
+	// the frame that last recorded this slot has to be complete
+	bool read(uint32_t slot, double& milliseconds) {
+		if (!isSupported() || !written[slot]) return false;
+		written[slot] = false;
+
+		uint64_t results[4] = {};	// begin, availability, end, availability
+		VkResult res = vkGetQueryPoolResults(device, queryPool, slot * 2, 2, sizeof(results), results, sizeof(uint64_t) * 2,
+			VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+		if (res != VK_SUCCESS || results[1] == 0 || results[3] == 0) return false;
+
+		uint64_t mask = validBits >= 64 ? UINT64_MAX : (1ull << validBits) - 1;
+		uint64_t ticks = ((results[2] & mask) - (results[0] & mask)) & mask;
+		milliseconds = ticks * static_cast<double>(timestampPeriod) / 1e6;
+		return true;
+	}
+
+private:
+	VkDevice device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks* allocationCallbacks = nullptr;
+	VkQueryPool queryPool = VK_NULL_HANDLE;
+	uint32_t validBits = 0;
+	float timestampPeriod = 1.0f;
+	std::vector<bool> written;
+};
+
+struct TimingSummary {
+	size_t count = 0;
+	double average = 0.0;
+	double p50 = 0.0;
+	double p95 = 0.0;
+	double p99 = 0.0;
+	double max = 0.0;
+};
+
+// Collects per-frame timings over a fixed run after a number of warm-up frames and writes them as JSON.
+// Frames are identified by their frame number, so GPU times read back framesInFlight frames late are still
+// attributed to the frame that produced them.
+class FrameBenchmark {
+public:
+	void init(uint32_t warmupFrames, uint32_t measuredFrames) {
+		this->warmupFrames = warmupFrames;
+		this->measuredFrames = measuredFrames;
+		frameTimes.reserve(measuredFrames);
+		cpuTimes.reserve(measuredFrames);
+		recordTimes.reserve(measuredFrames);
+		gpuTimes.reserve(measuredFrames);
+	}
+
+	uint64_t lastFrame() const {
+		return static_cast<uint64_t>(warmupFrames) + measuredFrames;
+	}
+
+	bool isMeasured(uint64_t frame) const {
+		return frame > warmupFrames && frame <= lastFrame();
+	}
+
+	// frameMs: start of the previous frame to the start of this one; cpuMs: this frame's CPU work without the
+	// pacing waits, image acquire and present; recordMs: the part of it spent recording the command buffer
+	void onFrame(uint64_t frame, double frameMs, double cpuMs, double recordMs) {
+		if (!isMeasured(frame)) return;
+		frameTimes.push_back(frameMs);
+		cpuTimes.push_back(cpuMs);
+		recordTimes.push_back(recordMs);
+	}
+
+	void onGpuTime(uint64_t frame, double gpuMs) {
+		if (!isMeasured(frame)) return;
+		gpuTimes.push_back(gpuMs);
+	}
+
+	static TimingSummary summarize(std::vector<double> values) {
+		TimingSummary summary;
+		summary.count = values.size();
+		if (values.empty()) return summary;
+
+		std::sort(values.begin(), values.end());
+		double sum = 0.0;
+		for (double value : values) sum += value;
+		summary.average = sum / values.size();
+		summary.p50 = percentile(values, 0.50);
+		summary.p95 = percentile(values, 0.95);
+		summary.p99 = percentile(values, 0.99);
+		summary.max = values.back();
+		return summary;
+	}
+
+	// runInfo: already formatted "key": value pairs describing the run, written ahead of the timings
+	void writeJson(const std::string& path, const std::vector<std::pair<std::string, std::string>>& runInfo) const {
+		std::ofstream out(path);
+		if (!out) {
+			throw std::runtime_error("failed to open benchmark output: " + path);
+		}
+		out << "{\n";
+		for (const auto& entry : runInfo) {
+			out << "  \"" << entry.first << "\": " << entry.second << ",\n";
+		}
+		out << "  \"warmupFrames\": " << warmupFrames << ",\n";
+		out << "  \"measuredFrames\": " << measuredFrames << ",\n";
+		writeSummary(out, "frameMs", summarize(frameTimes), false);
+		writeSummary(out, "cpuMs", summarize(cpuTimes), false);
+		writeSummary(out, "recordMs", summarize(recordTimes), false);
+		writeSummary(out, "gpuMs", summarize(gpuTimes), true);
+		out << "}\n";
+	}
+
+	static std::string quote(const std::string& value) {
+		std::string ret = "\"";
+		for (char c : value) {
+			if (c == '"' || c == '\\') ret += '\\';
+			ret += c;
+		}
+		return ret + "\"";
+	}
+
+private:
+	uint32_t warmupFrames = 0;
+	uint32_t measuredFrames = 0;
+	std::vector<double> frameTimes;
+	std::vector<double> cpuTimes;
+	std::vector<double> recordTimes;
+	std::vector<double> gpuTimes;
+
+	// nearest rank on sorted values
+	static double percentile(const std::vector<double>& sorted, double fraction) {
+		size_t rank = static_cast<size_t>(std::ceil(fraction * sorted.size()));
+		return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+	}
+
+	static void writeSummary(std::ostream& out, const char* name, const TimingSummary& summary, bool last) {
+		out << "  \"" << name << "\": ";
+		if (summary.count == 0) {
+			out << "null";
+		}
+		else {
+			out << "{ \"count\": " << summary.count << ", \"avg\": " << summary.average << ", \"p50\": " << summary.p50
+				<< ", \"p95\": " << summary.p95 << ", \"p99\": " << summary.p99 << ", \"max\": " << summary.max << " }";
+		}
+		out << (last ? "\n" : ",\n");
+	}
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vector>
+#include <stdexcept>
+
+#include <vulkan/vulkan_core.h>
+
+// Command buffers for one frame slot on one thread. Buffers are handed out linearly and all of them are
+// recycled at once by vkResetCommandPool when the slot comes round again, so the driver never tracks
+// individual buffers. perBufferReset keeps the old scheme, a pool with RESET_COMMAND_BUFFER_BIT and
+// a vkResetCommandBuffer per buffer, to compare against. transient tells the driver the buffers only live
+// for a frame; pools whose buffers are kept and replayed over many frames leave it off.
+class FrameCommandPool {
+public:
+	void init(VkDevice device, uint32_t queueFamily, bool perBufferReset, bool transient, const VkAllocationCallbacks* allocationCallbacks) {
+		this->device = device;
+		this->perBufferReset = perBufferReset;
+		this->allocationCallbacks = allocationCallbacks;
+
+		VkCommandPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+		poolInfo.flags = (perBufferReset ? VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT : 0) | (transient ? VK_COMMAND_POOL_CREATE_TRANSIENT_BIT : 0);
+		poolInfo.queueFamilyIndex = queueFamily;
+		if (vkCreateCommandPool(device, &poolInfo, allocationCallbacks, &pool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create frame command pool!");
+		}
+	}
+
+	void destroy() {
+		vkDestroyCommandPool(device, pool, allocationCallbacks);
+		pool = VK_NULL_HANDLE;
+		primaries.clear();
+		secondaries.clear();
+	}
+
+	// everything handed out since the last reset must be done on the GPU
+	void reset() {
+		if (!perBufferReset) {
+			vkResetCommandPool(device, pool, 0);
+		}
+		nextPrimary = 0;
+		nextSecondary = 0;
+	}
+
+	VkCommandBuffer allocatePrimary() {
+		return next(primaries, nextPrimary, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+	}
+
+	VkCommandBuffer allocateSecondary() {
+		return next(secondaries, nextSecondary, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+	}
+
+private:
+	VkDevice device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks* allocationCallbacks = nullptr;
+	VkCommandPool pool = VK_NULL_HANDLE;
+	bool perBufferReset = false;
+	std::vector<VkCommandBuffer> primaries;
+	std::vector<VkCommandBuffer> secondaries;
+	size_t nextPrimary = 0;
+	size_t nextSecondary = 0;
+
+	// buffers stay allocated across resets, the pool only grows to the most a frame has needed
+	VkCommandBuffer next(std::vector<VkCommandBuffer>& buffers, size_t& index, VkCommandBufferLevel level) {
+		if (index == buffers.size()) {
+			VkCommandBufferAllocateInfo allocInfo{};
+			allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			allocInfo.commandPool = pool;
+			allocInfo.level = level;
+			allocInfo.commandBufferCount = 1;
+			VkCommandBuffer commandBuffer;
+			if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+				throw std::runtime_error("failed to allocate frame command buffer!");
+			}
+			buffers.push_back(commandBuffer);
+		}
+		else if (perBufferReset) {
+			vkResetCommandBuffer(buffers[index], 0);
+		}
+		return buffers[index++];
+	}
+};
@@ -0,0 +1,272 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <ostream>
+#include <stdexcept>
+
+#include <vulkan/vulkan_core.h>
+#include "TimelineSemaphore.h"
+
+// How many frames the CPU may run ahead of the GPU and how many swapchain images back them.
+// extraSwapchainImages counts on top of the surface's minImageCount.
+struct FrameProfile {
+	std::string name;
+	uint32_t framesInFlight;
+	uint32_t extraSwapchainImages;
+};
+
+const std::vector<FrameProfile> FRAME_PROFILES = {
+	{ "low-latency", 1, 0 },
+	{ "balanced", 2, 1 },
+	{ "max-throughput", 3, 2 },
+};
+
+FrameProfile findFrameProfile(const std::string& name) {
+	for (const auto& profile : FRAME_PROFILES) {
+		if (profile.name == name) return profile;
+	}
+	throw std::runtime_error("unknown frame profile: " + name);
+}
+
+// Input-to-present latency. The first input after a frame has been picked up is stamped, attached to the
+// next frame that starts recording, and measured up to that frame's present call, to the moment its GPU work
+// is seen complete on the frame timeline and, with VK_KHR_present_wait, to the moment the pacer sees it on
+// screen. The pacer only looks once per frame, so a frame that reached the display while the CPU was busy
+// elsewhere is counted late by up to that delay.
+class LatencyTracker {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	void onInput() {
+		if (!inputPending) {
+			inputPending = true;
+			inputTime = Clock::now();
+		}
+	}
+
+	void onFrameStart(uint64_t frame) {
+		if (!inputPending) return;
+		inputPending = false;
+		inFlight.push_back(Sample{ frame, inputTime });
+	}
+
+	void onPresentCall(uint64_t frame) {
+		for (auto& sample : inFlight) {
+			if (sample.frame == frame) {
+				sample.toPresentCallMs = millisecondsSince(sample.inputTime);
+			}
+		}
+	}
+
+	void onFrameComplete(uint64_t completedFrame) {
+		for (auto& sample : inFlight) {
+			if (sample.frame > completedFrame) break;
+			if (sample.toCompleteMs < 0.0) {
+				sample.toCompleteMs = millisecondsSince(sample.inputTime);
+			}
+		}
+	}
+
+	// frame is complete and the pacer is done waiting for it; displayed when present wait saw it on screen
+	void onFrameRetired(uint64_t frame, bool displayed) {
+		onFrameComplete(frame);
+		while (!inFlight.empty() && inFlight.front().frame <= frame) {
+			const Sample& sample = inFlight.front();
+			presentCallLatencies.push_back(sample.toPresentCallMs);
+			completeLatencies.push_back(sample.toCompleteMs);
+			if (displayed && sample.frame == frame) {
+				displayLatencies.push_back(millisecondsSince(sample.inputTime));
+			}
+			inFlight.pop_front();
+		}
+	}
+
+	bool hasFramesInFlight() const {
+		return !inFlight.empty();
+	}
+
+	void report(std::ostream& out, const std::string& label) const {
+		out << "latency [" << label << "]: " << completeLatencies.size() << " samples";
+		if (!completeLatencies.empty()) {
+			out << ", input to present call avg " << average(presentCallLatencies) << " ms / p95 " << percentile(presentCallLatencies, 0.95)
+				<< " ms, input to GPU done avg " << average(completeLatencies) << " ms / p95 " << percentile(completeLatencies, 0.95) << " ms";
+		}
+		if (!displayLatencies.empty()) {
+			out << ", input to display avg " << average(displayLatencies) << " ms / p95 " << percentile(displayLatencies, 0.95)
+				<< " ms (" << displayLatencies.size() << " samples)";
+		}
+		else {
+			out << ", input to display not measured (no VK_KHR_present_wait)";
+		}
+		out << '\n';
+	}
+
+	void reset() {
+		inputPending = false;
+		inFlight.clear();
+		presentCallLatencies.clear();
+		completeLatencies.clear();
+		displayLatencies.clear();
+	}
+
+private:
+	struct Sample {
+		uint64_t frame;
+		Clock::time_point inputTime;
+		double toPresentCallMs = 0.0;
+		double toCompleteMs = -1.0;
+	};
+
+	bool inputPending = false;
+	Clock::time_point inputTime;
+	std::deque<Sample> inFlight;
+	std::vector<double> presentCallLatencies;
+	std::vector<double> completeLatencies;
+	std::vector<double> displayLatencies;
+
+	static double millisecondsSince(Clock::time_point start) {
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	static double average(const std::vector<double>& values) {
+		double sum = 0.0;
+		for (double value : values) sum += value;
+		return values.empty() ? 0.0 : sum / values.size();
+	}
+
+	static double percentile(std::vector<double> values, double fraction) {
+		if (values.empty()) return 0.0;
+		size_t index = std::min(values.size() - 1, static_cast<size_t>(fraction * values.size()));
+		std::nth_element(values.begin(), values.begin() + index, values.end());
+		return values[index];
+	}
+};
+
+// Starts each frame just in time: before recording frame N the CPU blocks until frame N - framesInFlight
+// has reached the display (VK_KHR_present_wait, frames carry their number as present id) instead of only
+// until the GPU has finished it. Without the extensions it falls back to GPU completion on the frame
+// timeline. Either way the time from a frame's CPU start to that point is recorded.
+class PresentPacer {
+public:
+	void init(VkDevice device, bool presentWaitEnabled) {
+		this->device = device;
+		if (presentWaitEnabled) {
+			waitForPresent = (PFN_vkWaitForPresentKHR)vkGetDeviceProcAddr(device, "vkWaitForPresentKHR");
+		}
+	}
+
+	bool usesPresentWait() const {
+		return waitForPresent != nullptr;
+	}
+
+	// present ids are per swapchain; frames presented to an older one can't be waited on
+	void onSwapchainRecreated(uint64_t firstFrame) {
+		firstFrameOnSwapchain = firstFrame;
+	}
+
+	void onFrameStart(uint64_t frame) {
+		starts.emplace_back(frame, Clock::now());
+	}
+
+	// true when present wait confirmed the frame is on screen, false when it fell back to GPU completion
+	bool waitUntilDisplayed(VkSwapchainKHR swapchain, uint64_t frame, TimelineSemaphore& frameTimeline) {
+		if (frame == 0) return false;
+
+		bool presented = false;
+		if (waitForPresent && frame >= firstFrameOnSwapchain) {
+			// bounded: a frame whose present failed never gets its id, a later one will
+			VkResult res = waitForPresent(device, swapchain, frame, PRESENT_WAIT_TIMEOUT);
+			presented = res == VK_SUCCESS || res == VK_SUBOPTIMAL_KHR;
+		}
+		if (!presented) {
+			frameTimeline.wait(frame);
+		}
+
+		while (!starts.empty() && starts.front().first < frame) {
+			starts.pop_front();
+		}
+		if (!starts.empty() && starts.front().first == frame) {
+			double latencyMs = std::chrono::duration<double, std::milli>(Clock::now() - starts.front().second).count();
+			(presented ? presentLatencies : completionLatencies).push_back(latencyMs);
+			starts.pop_front();
+		}
+		return presented;
+	}
+
+	void report(std::ostream& out) const {
+		out << "frame start to display: " << presentLatencies.size() << " frames";
+		if (!presentLatencies.empty()) {
+			out << ", avg " << average(presentLatencies) << " ms, max " << *std::max_element(presentLatencies.begin(), presentLatencies.end()) << " ms";
+		}
+		out << "; frame start to GPU done (fallback): " << completionLatencies.size() << " frames";
+		if (!completionLatencies.empty()) {
+			out << ", avg " << average(completionLatencies) << " ms, max " << *std::max_element(completionLatencies.begin(), completionLatencies.end()) << " ms";
+		}
+		out << '\n';
+	}
+
+private:
+	using Clock = std::chrono::steady_clock;
+	static constexpr uint64_t PRESENT_WAIT_TIMEOUT = 100ull * 1000 * 1000;
+
+	VkDevice device = VK_NULL_HANDLE;
+	PFN_vkWaitForPresentKHR waitForPresent = nullptr;
+	uint64_t firstFrameOnSwapchain = 0;
+	std::deque<std::pair<uint64_t, Clock::time_point>> starts;
+	std::vector<double> presentLatencies;
+	std::vector<double> completionLatencies;
+
+	static double average(const std::vector<double>& values) {
+		double sum = 0.0;
+		for (double value : values) sum += value;
+		return sum / values.size();
+	}
+};
+
+// CPU frame times, split into frames shortly after a swapchain recreation and the rest, to see what
+// resizing costs.
+class FrameTimeTracker {
+public:
+	void onFrame() {
+		Clock::time_point now = Clock::now();
+		if (hasLastFrame) {
+			double frameMs = std::chrono::duration<double, std::milli>(now - lastFrame).count();
+			bool resizing = recreations > 0 && now - lastRecreation < RESIZE_WINDOW;
+			if (resizing) {
+				worstDuringResizeMs = std::max(worstDuringResizeMs, frameMs);
+				resizeFrames++;
+			}
+			else {
+				worstSteadyMs = std::max(worstSteadyMs, frameMs);
+			}
+		}
+		hasLastFrame = true;
+		lastFrame = now;
+	}
+
+	void onSwapchainRecreated() {
+		lastRecreation = Clock::now();
+		recreations++;
+	}
+
+	void report(std::ostream& out, const char* recreateMode) const {
+		out << "frame time, swapchain recreation by " << recreateMode << ": worst " << worstSteadyMs << " ms steady, worst "
+			<< worstDuringResizeMs << " ms over " << resizeFrames << " frames around " << recreations << " recreations\n";
+	}
+
+private:
+	using Clock = std::chrono::steady_clock;
+	static constexpr std::chrono::milliseconds RESIZE_WINDOW{ 500 };
+
+	bool hasLastFrame = false;
+	Clock::time_point lastFrame;
+	Clock::time_point lastRecreation;
+	uint32_t recreations = 0;
+	uint32_t resizeFrames = 0;
+	double worstSteadyMs = 0.0;
+	double worstDuringResizeMs = 0.0;
+};
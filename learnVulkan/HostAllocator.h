@@ -0,0 +1,287 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <ostream>
+
+#include <vulkan/vulkan_core.h>
+
+struct HostScopeStats {
+	uint64_t allocations = 0;
+	uint64_t frees = 0;
+	uint64_t reallocations = 0;
+	uint64_t liveBytes = 0;
+	uint64_t peakBytes = 0;
+};
+
+// VkAllocationCallbacks for driver host memory. Object-scope allocations come from size-class pools,
+// command-scope allocations from a linear arena owned by the calling thread (rewound once everything
+// in it has been freed), and everything else from the CRT heap. Counters are kept per
+// VkSystemAllocationScope; all entry points are thread safe as the spec requires.
+class HostAllocator {
+public:
+	HostAllocator() {
+		callbacks.pUserData = this;
+		callbacks.pfnAllocation = &HostAllocator::allocationCallback;
+		callbacks.pfnReallocation = &HostAllocator::reallocationCallback;
+		callbacks.pfnFree = &HostAllocator::freeCallback;
+	}
+
+	~HostAllocator() {
+		for (void* slab : slabs) {
+			std::free(slab);
+		}
+	}
+
+	HostAllocator(const HostAllocator&) = delete;
+	HostAllocator& operator=(const HostAllocator&) = delete;
+
+	const VkAllocationCallbacks* getCallbacks() const {
+		return &callbacks;
+	}
+
+	HostScopeStats getStats(VkSystemAllocationScope scope) const {
+		const ScopeCounters& counters = scopes[scope];
+		HostScopeStats stats;
+		stats.allocations = counters.allocations.load();
+		stats.frees = counters.frees.load();
+		stats.reallocations = counters.reallocations.load();
+		stats.liveBytes = counters.liveBytes.load();
+		stats.peakBytes = counters.peakBytes.load();
+		return stats;
+	}
+
+	uint64_t getArenaFallbacks() const {
+		return arenaFallbacks.load();
+	}
+
+	void printStats(std::ostream& out) const {
+		static const char* scopeNames[SCOPE_COUNT] = { "command", "object", "cache", "device", "instance" };
+		for (uint32_t i = 0; i < SCOPE_COUNT; i++) {
+			HostScopeStats stats = getStats(static_cast<VkSystemAllocationScope>(i));
+			out << "host " << scopeNames[i] << " scope: " << stats.allocations << " allocations, " << stats.frees << " frees, "
+				<< stats.reallocations << " reallocations, " << stats.liveBytes << " bytes live, " << stats.peakBytes << " peak\n";
+		}
+		out << "command arena overflows to the heap: " << getArenaFallbacks() << '\n';
+	}
+
+private:
+	static constexpr uint32_t SCOPE_COUNT = VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1;
+	static constexpr size_t MIN_CLASS_SIZE = 32;
+	static constexpr size_t MAX_CLASS_SIZE = 4096;
+	static constexpr uint32_t CLASS_COUNT = 8;	// 32 .. 4096
+	static constexpr size_t SLAB_SIZE = 64 * 1024;
+	static constexpr size_t ARENA_SIZE = 256 * 1024;
+
+	enum class Source : uint32_t { Heap, Pool, Arena };
+
+	// sits right in front of every pointer handed to the driver
+	struct alignas(16) Header {
+		void* origin;
+		void* arena;
+		size_t size;
+		uint32_t scope;
+		Source source;
+		uint32_t sizeClass;
+	};
+
+	struct ScopeCounters {
+		std::atomic<uint64_t> allocations{ 0 };
+		std::atomic<uint64_t> frees{ 0 };
+		std::atomic<uint64_t> reallocations{ 0 };
+		std::atomic<uint64_t> liveBytes{ 0 };
+		std::atomic<uint64_t> peakBytes{ 0 };
+	};
+
+	struct LinearArena {
+		std::unique_ptr<char[]> memory{ new char[ARENA_SIZE] };
+		size_t head = 0;
+		std::atomic<uint32_t> live{ 0 };
+	};
+
+	struct ThreadArena {
+		const HostAllocator* owner = nullptr;
+		LinearArena* arena = nullptr;
+	};
+
+	VkAllocationCallbacks callbacks{};
+	std::array<ScopeCounters, SCOPE_COUNT> scopes;
+	std::atomic<uint64_t> arenaFallbacks{ 0 };
+
+	std::mutex poolMutex;
+	std::array<void*, CLASS_COUNT> freeLists{};
+	std::vector<void*> slabs;
+
+	std::mutex arenaMutex;
+	std::vector<std::unique_ptr<LinearArena>> arenas;
+
+	static void* VKAPI_PTR allocationCallback(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+		return static_cast<HostAllocator*>(userData)->allocate(size, alignment, scope);
+	}
+
+	static void* VKAPI_PTR reallocationCallback(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+		return static_cast<HostAllocator*>(userData)->reallocate(original, size, alignment, scope);
+	}
+
+	static void VKAPI_PTR freeCallback(void* userData, void* memory) {
+		static_cast<HostAllocator*>(userData)->release(memory);
+	}
+
+	static Header* headerOf(void* memory) {
+		return reinterpret_cast<Header*>(memory) - 1;
+	}
+
+	// room for the header plus padding up to the requested alignment
+	static size_t footprint(size_t size, size_t alignment) {
+		return size + sizeof(Header) + (alignment > alignof(Header) ? alignment : 0);
+	}
+
+	static void* place(void* origin, size_t alignment) {
+		uintptr_t address = reinterpret_cast<uintptr_t>(origin) + sizeof(Header);
+		if (alignment > alignof(Header)) {
+			address = (address + alignment - 1) & ~(uintptr_t)(alignment - 1);
+		}
+		return reinterpret_cast<void*>(address);
+	}
+
+	static uint32_t sizeClassOf(size_t bytes) {
+		uint32_t sizeClass = 0;
+		size_t classSize = MIN_CLASS_SIZE;
+		while (classSize < bytes) {
+			classSize <<= 1;
+			sizeClass++;
+		}
+		return sizeClass;
+	}
+
+	void* allocate(size_t size, size_t alignment, VkSystemAllocationScope scope) {
+		if (size == 0) return nullptr;
+
+		size_t bytes = footprint(size, alignment);
+		void* origin = nullptr;
+		void* arena = nullptr;
+		Source source = Source::Heap;
+		uint32_t sizeClass = 0;
+
+		if (scope == VK_SYSTEM_ALLOCATION_SCOPE_COMMAND) {
+			LinearArena* threadArena = getThreadArena();
+			if (threadArena->live.load() == 0) {
+				threadArena->head = 0;
+			}
+			if (threadArena->head + bytes <= ARENA_SIZE) {
+				origin = threadArena->memory.get() + threadArena->head;
+				threadArena->head += (bytes + alignof(Header) - 1) & ~(alignof(Header) - 1);
+				threadArena->live++;
+				arena = threadArena;
+				source = Source::Arena;
+			}
+			else {
+				arenaFallbacks++;
+			}
+		}
+		else if (scope == VK_SYSTEM_ALLOCATION_SCOPE_OBJECT && bytes <= MAX_CLASS_SIZE) {
+			sizeClass = sizeClassOf(bytes);
+			origin = poolAllocate(sizeClass);
+			source = Source::Pool;
+		}
+
+		if (origin == nullptr) {
+			origin = std::malloc(bytes);
+			if (origin == nullptr) return nullptr;
+			source = Source::Heap;
+		}
+
+		void* memory = place(origin, alignment);
+		Header* header = headerOf(memory);
+		header->origin = origin;
+		header->arena = arena;
+		header->size = size;
+		header->scope = scope;
+		header->source = source;
+		header->sizeClass = sizeClass;
+
+		ScopeCounters& counters = scopes[scope];
+		counters.allocations++;
+		uint64_t live = counters.liveBytes += size;
+		uint64_t peak = counters.peakBytes.load();
+		while (live > peak && !counters.peakBytes.compare_exchange_weak(peak, live)) {}
+		return memory;
+	}
+
+	void* reallocate(void* original, size_t size, size_t alignment, VkSystemAllocationScope scope) {
+		if (original == nullptr) return allocate(size, alignment, scope);
+		if (size == 0) {
+			release(original);
+			return nullptr;
+		}
+
+		void* memory = allocate(size, alignment, scope);
+		if (memory == nullptr) return nullptr;
+		size_t oldSize = headerOf(original)->size;
+		memcpy(memory, original, oldSize < size ? oldSize : size);
+		release(original);
+		scopes[scope].reallocations++;
+		return memory;
+	}
+
+	void release(void* memory) {
+		if (memory == nullptr) return;
+
+		Header* header = headerOf(memory);
+		ScopeCounters& counters = scopes[header->scope];
+		counters.frees++;
+		counters.liveBytes -= header->size;
+
+		switch (header->source) {
+		case Source::Arena:
+			static_cast<LinearArena*>(header->arena)->live--;
+			break;
+		case Source::Pool:
+			poolFree(header->origin, header->sizeClass);
+			break;
+		case Source::Heap:
+			std::free(header->origin);
+			break;
+		}
+	}
+
+	void* poolAllocate(uint32_t sizeClass) {
+		std::lock_guard<std::mutex> lock(poolMutex);
+		if (freeLists[sizeClass] == nullptr) {
+			size_t classSize = MIN_CLASS_SIZE << sizeClass;
+			char* slab = static_cast<char*>(std::malloc(SLAB_SIZE));
+			if (slab == nullptr) return nullptr;
+			slabs.push_back(slab);
+			for (size_t offset = 0; offset + classSize <= SLAB_SIZE; offset += classSize) {
+				*reinterpret_cast<void**>(slab + offset) = freeLists[sizeClass];
+				freeLists[sizeClass] = slab + offset;
+			}
+		}
+		void* chunk = freeLists[sizeClass];
+		freeLists[sizeClass] = *reinterpret_cast<void**>(chunk);
+		return chunk;
+	}
+
+	void poolFree(void* chunk, uint32_t sizeClass) {
+		std::lock_guard<std::mutex> lock(poolMutex);
+		*reinterpret_cast<void**>(chunk) = freeLists[sizeClass];
+		freeLists[sizeClass] = chunk;
+	}
+
+	LinearArena* getThreadArena() {
+		static thread_local ThreadArena threadArena;
+		if (threadArena.owner != this) {
+			std::lock_guard<std::mutex> lock(arenaMutex);
+			arenas.push_back(std::make_unique<LinearArena>());
+			threadArena.owner = this;
+			threadArena.arena = arenas.back().get();
+		}
+		return threadArena.arena;
+	}
+};
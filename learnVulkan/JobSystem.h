@@ -0,0 +1,317 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+
+struct Job {
+	std::function<void()> work;
+	// unfinished dependencies, plus one held by submit until the job is fully wired up
+	std::atomic<uint32_t> pendingDependencies{ 1 };
+	std::atomic<bool> finished{ false };
+	// runs on a background thread, never on a worker; see submitBackground
+	bool background = false;
+
+	std::mutex mutex;	// guards everything below
+	bool completed = false;
+	std::vector<std::shared_ptr<Job>> continuations;
+	// set when the job or one of its dependencies threw; the work is skipped and the error passed on
+	std::exception_ptr error;
+};
+
+using JobHandle = std::shared_ptr<Job>;
+
+// Work-stealing scheduler. Every worker has its own deque: it pushes and pops its own jobs at the back, so it
+// keeps working on what it just produced, while idle workers steal the oldest jobs from the front of others.
+// The thread calling init becomes worker 0 and only runs jobs while it waits, so waiting never wastes a core.
+// A job runs once all its dependencies have finished; jobs that become ready go to the worker that released them.
+// Background jobs, for work nobody waits on yet such as pipeline compiles, have a queue and threads of their own:
+// workers never run them, so a frame waiting for its own jobs can't pick one up and run it inline.
+class JobSystem {
+public:
+	static constexpr uint32_t NOT_A_WORKER = UINT32_MAX;
+
+	// there is always at least one background thread, so waiting for a background job ends
+	void init(uint32_t threadCount, uint32_t backgroundThreadCount = 1) {
+		threadCount = std::max(threadCount, 1u);
+		this->backgroundThreadCount = std::max(backgroundThreadCount, 1u);
+		queues.clear();
+		for (uint32_t i = 0; i < threadCount; i++) {
+			queues.push_back(std::make_unique<WorkerQueue>());
+		}
+		stopping = false;
+		workerIndex() = 0;
+		for (uint32_t i = 1; i < threadCount; i++) {
+			threads.emplace_back(&JobSystem::workerLoop, this, i);
+		}
+		for (uint32_t i = 0; i < this->backgroundThreadCount; i++) {
+			threads.emplace_back(&JobSystem::backgroundLoop, this);
+		}
+	}
+
+	// every submitted job has to be finished
+	void destroy() {
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		backgroundWake.notify_all();
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		threads.clear();
+		queues.clear();
+	}
+
+	uint32_t getThreadCount() const {
+		return static_cast<uint32_t>(queues.size());
+	}
+
+	uint32_t getBackgroundThreadCount() const {
+		return backgroundThreadCount;
+	}
+
+	// index of the worker running on the calling thread, for per-worker resources such as command pools
+	static uint32_t currentWorker() {
+		return workerIndex();
+	}
+
+	JobHandle submit(std::function<void()> work, const std::vector<JobHandle>& dependencies = {}) {
+		return submitJob(std::move(work), dependencies, false);
+	}
+
+	// Like submit, but the job runs on a background thread. Its work must not submit or wait itself.
+	JobHandle submitBackground(std::function<void()> work, const std::vector<JobHandle>& dependencies = {}) {
+		return submitJob(std::move(work), dependencies, true);
+	}
+
+	// Runs other jobs until all of the given ones have finished, then rethrows the first error among them.
+	// Waits for every job even if one failed, since they may still reference the caller's locals. Background
+	// jobs are only waited for, the background threads run them.
+	void wait(const std::vector<JobHandle>& jobs) {
+		uint32_t worker = requireWorker();
+		for (const auto& job : jobs) {
+			while (!job->finished.load(std::memory_order_acquire)) {
+				if (!tryRunOne(worker)) {
+					std::this_thread::yield();
+				}
+			}
+		}
+		for (const auto& job : jobs) {
+			std::lock_guard<std::mutex> lock(job->mutex);
+			if (job->error) {
+				std::rethrow_exception(job->error);
+			}
+		}
+	}
+
+	// Calls fn on [begin, end) ranges of at most grainSize covering [0, count) and returns once all are done.
+	// The calling thread takes the first range itself.
+	void parallelFor(uint32_t count, uint32_t grainSize, const std::function<void(uint32_t begin, uint32_t end)>& fn) {
+		if (count == 0) return;
+		grainSize = std::max(grainSize, 1u);
+		uint32_t rangeCount = (count - 1) / grainSize + 1;
+
+		std::vector<JobHandle> jobs;
+		jobs.reserve(rangeCount - 1);
+		for (uint32_t range = 1; range < rangeCount; range++) {
+			uint32_t begin = range * grainSize;
+			uint32_t end = std::min(begin + grainSize, count);
+			jobs.push_back(submit([&fn, begin, end]() { fn(begin, end); }));
+		}
+
+		std::exception_ptr ownError;
+		try {
+			fn(0, std::min(grainSize, count));
+		}
+		catch (...) {
+			ownError = std::current_exception();
+		}
+		wait(jobs);
+		if (ownError) {
+			std::rethrow_exception(ownError);
+		}
+	}
+
+private:
+	struct WorkerQueue {
+		std::mutex mutex;
+		std::deque<JobHandle> jobs;
+	};
+
+	std::vector<std::unique_ptr<WorkerQueue>> queues;
+	WorkerQueue backgroundQueue;
+	std::vector<std::thread> threads;
+	uint32_t backgroundThreadCount = 0;
+	std::atomic<uint32_t> queued{ 0 };
+	std::atomic<uint32_t> backgroundQueued{ 0 };
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+	std::condition_variable backgroundWake;
+	bool stopping = false;
+
+	static uint32_t& workerIndex() {
+		thread_local uint32_t index = NOT_A_WORKER;
+		return index;
+	}
+
+	uint32_t requireWorker() const {
+		uint32_t worker = workerIndex();
+		if (worker >= queues.size()) {
+			throw std::runtime_error("job system used from a thread that is not one of its workers!");
+		}
+		return worker;
+	}
+
+	JobHandle submitJob(std::function<void()> work, const std::vector<JobHandle>& dependencies, bool background) {
+		requireWorker();
+		JobHandle job = std::make_shared<Job>();
+		job->work = std::move(work);
+		job->background = background;
+		for (const auto& dependency : dependencies) {
+			std::lock_guard<std::mutex> lock(dependency->mutex);
+			if (!dependency->completed) {
+				job->pendingDependencies++;
+				dependency->continuations.push_back(job);
+			}
+			else if (dependency->error) {
+				std::lock_guard<std::mutex> jobLock(job->mutex);
+				job->error = dependency->error;
+			}
+		}
+		release(job);
+		return job;
+	}
+
+	void release(const JobHandle& job) {
+		if (--job->pendingDependencies > 0) return;
+
+		if (job->background) {
+			backgroundQueued++;
+			{
+				std::lock_guard<std::mutex> lock(backgroundQueue.mutex);
+				backgroundQueue.jobs.push_back(job);
+			}
+			{
+				std::lock_guard<std::mutex> lock(sleepMutex);
+			}
+			backgroundWake.notify_one();
+			return;
+		}
+		// a background thread finishing a dependency hands what it released to worker 0, for any worker to steal
+		uint32_t worker = workerIndex();
+		WorkerQueue& queue = *queues[worker < queues.size() ? worker : 0];
+		// counted before it is visible, so a worker taking it right away can't take queued below zero
+		queued++;
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.jobs.push_back(job);
+		}
+		// taking the lock orders this against a worker between checking queued and going to sleep
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+		}
+		wake.notify_one();
+	}
+
+	bool tryRunOne(uint32_t worker) {
+		JobHandle job;
+		{
+			WorkerQueue& own = *queues[worker];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if (!own.jobs.empty()) {
+				job = std::move(own.jobs.back());
+				own.jobs.pop_back();
+			}
+		}
+		for (size_t i = 1; !job && i < queues.size(); i++) {
+			WorkerQueue& victim = *queues[(worker + i) % queues.size()];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (!victim.jobs.empty()) {
+				job = std::move(victim.jobs.front());
+				victim.jobs.pop_front();
+			}
+		}
+		if (!job) return false;
+
+		queued--;
+		run(job);
+		return true;
+	}
+
+	void run(const JobHandle& job) {
+		std::exception_ptr error;
+		{
+			std::lock_guard<std::mutex> lock(job->mutex);
+			error = job->error;
+		}
+		if (!error) {
+			try {
+				job->work();
+			}
+			catch (...) {
+				error = std::current_exception();
+			}
+		}
+		job->work = nullptr;
+
+		std::vector<JobHandle> continuations;
+		{
+			std::lock_guard<std::mutex> lock(job->mutex);
+			job->error = error;
+			job->completed = true;
+			continuations.swap(job->continuations);
+		}
+		for (const auto& continuation : continuations) {
+			if (error) {
+				std::lock_guard<std::mutex> lock(continuation->mutex);
+				if (!continuation->error) continuation->error = error;
+			}
+			release(continuation);
+		}
+		job->finished.store(true, std::memory_order_release);
+	}
+
+	void workerLoop(uint32_t index) {
+		workerIndex() = index;
+		for (;;) {
+			if (tryRunOne(index)) continue;
+
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			wake.wait(lock, [this]() { return stopping || queued.load() > 0; });
+			if (stopping) return;
+		}
+	}
+
+	// background jobs run in submission order
+	void backgroundLoop() {
+		for (;;) {
+			JobHandle job;
+			{
+				std::lock_guard<std::mutex> lock(backgroundQueue.mutex);
+				if (!backgroundQueue.jobs.empty()) {
+					job = std::move(backgroundQueue.jobs.front());
+					backgroundQueue.jobs.pop_front();
+				}
+			}
+			if (job) {
+				backgroundQueued--;
+				run(job);
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			backgroundWake.wait(lock, [this]() { return stopping || backgroundQueued.load() > 0; });
+			if (stopping) return;
+		}
+	}
+};
@@ -0,0 +1,313 @@
+#pragma once
+
+#include <vector>
+#include <map>
+#include <iterator>
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+
+#include <vulkan/vulkan_core.h>
+#include "MemoryTypeSelector.h"
+
+inline VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+	return alignment > 1 ? (value + alignment - 1) / alignment * alignment : value;
+}
+
+// A sub-range of a VkDeviceMemory block. Host-visible blocks stay mapped for their whole lifetime,
+// so mapped already points at offset and callers must not vkMapMemory the block themselves.
+struct MemoryAllocation {
+	VkDeviceMemory memory = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	VkDeviceSize size = 0;
+	uint32_t memoryTypeIndex = 0;
+	uint32_t blockIndex = 0;
+	void* mapped = nullptr;
+};
+
+struct MemoryHeapStats {
+	VkDeviceSize heapSize = 0;
+	VkDeviceSize reservedBytes = 0;
+	VkDeviceSize usedBytes = 0;
+	VkDeviceSize largestFreeRange = 0;
+	uint32_t blockCount = 0;
+	uint32_t allocationCount = 0;
+	uint32_t freeRangeCount = 0;
+	// 0 when the free space of the heap is one contiguous range, towards 1 as it splinters
+	float fragmentation = 0.0f;
+};
+
+// Hands out buffer memory from large per-memory-type blocks instead of one vkAllocateMemory per buffer.
+// Free space of a block is an offset-ordered list of ranges: first fit with alignment padding on allocate,
+// neighbours coalesced on free. Only buffers are sub-allocated; images get memory of their own, so
+// bufferImageGranularity is not a concern.
+class DeviceMemoryAllocator {
+public:
+	static constexpr uint32_t DEDICATED_BLOCK = UINT32_MAX;
+	static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+
+	void init(VkDevice device, VkPhysicalDevice physicalDevice, bool memoryBudgetSupported, VkDeviceSize preferredBlockSize = DEFAULT_BLOCK_SIZE) {
+		this->device = device;
+		memoryTypes.init(physicalDevice, memoryBudgetSupported);
+		memProperties = memoryTypes.getProperties();
+
+		blocks.resize(memProperties.memoryTypeCount);
+		blockSizes.resize(memProperties.memoryTypeCount);
+		for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+			// small heaps (BAR windows, integrated carve-outs) get smaller blocks so one block can't eat the heap
+			VkDeviceSize heapSize = memProperties.memoryHeaps[memProperties.memoryTypes[i].heapIndex].size;
+			blockSizes[i] = heapSize <= 1024ull * 1024 * 1024 ? std::min(preferredBlockSize, heapSize / 8) : preferredBlockSize;
+		}
+	}
+
+	void destroy() {
+		for (auto& typeBlocks : blocks) {
+			for (auto& block : typeBlocks) {
+				if (block.memory != VK_NULL_HANDLE) {
+					freeMemory(block.memory, block.size, block.typeIndex);
+				}
+			}
+		}
+		blocks.clear();
+		dedicatedAllocationCount = 0;
+		dedicatedBytes.clear();
+	}
+
+	MemoryAllocation allocate(const VkMemoryRequirements& requirements, MemoryUsage usage) {
+		uint32_t typeIndex = memoryTypes.select(requirements.memoryTypeBits, usage, requirements.size);
+		if (requirements.size > blockSizes[typeIndex] / 2) {
+			return allocateDedicated(requirements.size, typeIndex);
+		}
+
+		MemoryAllocation allocation{};
+		auto& typeBlocks = blocks[typeIndex];
+		for (uint32_t i = 0; i < typeBlocks.size(); i++) {
+			if (typeBlocks[i].memory != VK_NULL_HANDLE && suballocate(typeBlocks[i], requirements, allocation)) {
+				allocation.memoryTypeIndex = typeIndex;
+				allocation.blockIndex = i;
+				return allocation;
+			}
+		}
+
+		uint32_t blockIndex = createBlock(typeIndex);
+		if (!suballocate(blocks[typeIndex][blockIndex], requirements, allocation)) {
+			throw std::runtime_error("failed to sub-allocate from a fresh memory block");
+		}
+		allocation.memoryTypeIndex = typeIndex;
+		allocation.blockIndex = blockIndex;
+		return allocation;
+	}
+
+	MemoryAllocation allocateImage(const VkMemoryRequirements& requirements, MemoryUsage usage) {
+		return allocateDedicated(requirements.size, memoryTypes.select(requirements.memoryTypeBits, usage, requirements.size));
+	}
+
+	void free(MemoryAllocation& allocation) {
+		if (allocation.memory == VK_NULL_HANDLE) return;
+
+		if (allocation.blockIndex == DEDICATED_BLOCK) {
+			freeMemory(allocation.memory, allocation.size, allocation.memoryTypeIndex);
+			dedicatedAllocationCount--;
+			dedicatedBytes[memProperties.memoryTypes[allocation.memoryTypeIndex].heapIndex] -= allocation.size;
+			allocation = MemoryAllocation{};
+			return;
+		}
+
+		auto& typeBlocks = blocks[allocation.memoryTypeIndex];
+		MemoryBlock& block = typeBlocks[allocation.blockIndex];
+		releaseRange(block, allocation.offset, allocation.size);
+		block.usedBytes -= allocation.size;
+		block.allocationCount--;
+
+		// keep one empty block per type around so alloc/free churn doesn't hit vkAllocateMemory
+		if (block.allocationCount == 0) {
+			uint32_t liveBlocks = 0;
+			for (const auto& other : typeBlocks) {
+				if (other.memory != VK_NULL_HANDLE) liveBlocks++;
+			}
+			if (liveBlocks > 1) {
+				freeMemory(block.memory, block.size, allocation.memoryTypeIndex);
+				block = MemoryBlock{};
+			}
+		}
+		allocation = MemoryAllocation{};
+	}
+
+	const MemoryTypeSelector& getMemoryTypes() const {
+		return memoryTypes;
+	}
+
+	std::vector<MemoryHeapStats> getHeapStats() const {
+		std::vector<MemoryHeapStats> stats(memProperties.memoryHeapCount);
+		std::vector<VkDeviceSize> freeBytes(memProperties.memoryHeapCount, 0);
+		for (uint32_t i = 0; i < memProperties.memoryHeapCount; i++) {
+			stats[i].heapSize = memProperties.memoryHeaps[i].size;
+		}
+
+		for (uint32_t typeIndex = 0; typeIndex < blocks.size(); typeIndex++) {
+			uint32_t heapIndex = memProperties.memoryTypes[typeIndex].heapIndex;
+			MemoryHeapStats& heap = stats[heapIndex];
+			for (const auto& block : blocks[typeIndex]) {
+				if (block.memory == VK_NULL_HANDLE) continue;
+				heap.blockCount++;
+				heap.reservedBytes += block.size;
+				heap.usedBytes += block.usedBytes;
+				heap.allocationCount += block.allocationCount;
+				heap.freeRangeCount += static_cast<uint32_t>(block.freeRanges.size());
+				for (const auto& range : block.freeRanges) {
+					heap.largestFreeRange = std::max(heap.largestFreeRange, range.second);
+					freeBytes[heapIndex] += range.second;
+				}
+			}
+		}
+
+		for (uint32_t i = 0; i < memProperties.memoryHeapCount; i++) {
+			auto it = dedicatedBytes.find(i);
+			if (it != dedicatedBytes.end()) {
+				stats[i].reservedBytes += it->second;
+				stats[i].usedBytes += it->second;
+			}
+			if (freeBytes[i] > 0) {
+				stats[i].fragmentation = 1.0f - static_cast<float>(stats[i].largestFreeRange) / static_cast<float>(freeBytes[i]);
+			}
+		}
+		return stats;
+	}
+
+	void printStats(std::ostream& out) const {
+		auto stats = getHeapStats();
+		for (uint32_t i = 0; i < stats.size(); i++) {
+			const auto& heap = stats[i];
+			if (heap.reservedBytes == 0) continue;
+			MemoryHeapBudget budget = memoryTypes.getBudget(i);
+			out << "heap " << i << ": " << heap.usedBytes << " / " << heap.reservedBytes << " bytes used in "
+				<< heap.blockCount << " blocks, " << heap.allocationCount << " allocations, "
+				<< heap.freeRangeCount << " free ranges, fragmentation " << heap.fragmentation
+				<< ", budget " << budget.usage << " / " << budget.budget << '\n';
+		}
+		out << "dedicated allocations: " << dedicatedAllocationCount << '\n';
+	}
+
+private:
+	struct MemoryBlock {
+		VkDeviceMemory memory = VK_NULL_HANDLE;
+		VkDeviceSize size = 0;
+		VkDeviceSize usedBytes = 0;
+		uint32_t typeIndex = 0;
+		uint32_t allocationCount = 0;
+		void* mapped = nullptr;
+		// offset -> size of every free range, kept sorted so neighbours can be merged
+		std::map<VkDeviceSize, VkDeviceSize> freeRanges;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	MemoryTypeSelector memoryTypes;
+	VkPhysicalDeviceMemoryProperties memProperties{};
+	std::vector<VkDeviceSize> blockSizes;
+	std::vector<std::vector<MemoryBlock>> blocks;
+	uint32_t dedicatedAllocationCount = 0;
+	std::map<uint32_t, VkDeviceSize> dedicatedBytes;
+
+	VkDeviceMemory allocateMemory(VkDeviceSize size, uint32_t typeIndex, void** mapped) {
+		VkMemoryAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = size;
+		allocInfo.memoryTypeIndex = typeIndex;
+
+		VkDeviceMemory memory;
+		if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate device memory block!");
+		}
+
+		memoryTypes.trackAllocation(memProperties.memoryTypes[typeIndex].heapIndex, size, false);
+
+		*mapped = nullptr;
+		if (memProperties.memoryTypes[typeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+			if (vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, mapped) != VK_SUCCESS) {
+				throw std::runtime_error("failed to map device memory block!");
+			}
+		}
+		return memory;
+	}
+
+	void freeMemory(VkDeviceMemory memory, VkDeviceSize size, uint32_t typeIndex) {
+		vkFreeMemory(device, memory, nullptr);
+		memoryTypes.trackAllocation(memProperties.memoryTypes[typeIndex].heapIndex, size, true);
+	}
+
+	MemoryAllocation allocateDedicated(VkDeviceSize size, uint32_t typeIndex) {
+		MemoryAllocation allocation{};
+		allocation.memory = allocateMemory(size, typeIndex, &allocation.mapped);
+		allocation.size = size;
+		allocation.memoryTypeIndex = typeIndex;
+		allocation.blockIndex = DEDICATED_BLOCK;
+		dedicatedAllocationCount++;
+		dedicatedBytes[memProperties.memoryTypes[typeIndex].heapIndex] += size;
+		return allocation;
+	}
+
+	uint32_t createBlock(uint32_t typeIndex) {
+		auto& typeBlocks = blocks[typeIndex];
+		uint32_t index = 0;
+		while (index < typeBlocks.size() && typeBlocks[index].memory != VK_NULL_HANDLE) {
+			index++;
+		}
+		if (index == typeBlocks.size()) {
+			typeBlocks.emplace_back();
+		}
+
+		MemoryBlock& block = typeBlocks[index];
+		block.size = blockSizes[typeIndex];
+		block.typeIndex = typeIndex;
+		block.memory = allocateMemory(block.size, typeIndex, &block.mapped);
+		block.freeRanges[0] = block.size;
+		return index;
+	}
+
+	bool suballocate(MemoryBlock& block, const VkMemoryRequirements& requirements, MemoryAllocation& allocation) {
+		if (block.size - block.usedBytes < requirements.size) return false;
+
+		for (auto it = block.freeRanges.begin(); it != block.freeRanges.end(); ++it) {
+			VkDeviceSize rangeOffset = it->first;
+			VkDeviceSize rangeSize = it->second;
+			VkDeviceSize alignedOffset = alignUp(rangeOffset, requirements.alignment);
+			VkDeviceSize padding = alignedOffset - rangeOffset;
+			if (padding + requirements.size > rangeSize) continue;
+
+			block.freeRanges.erase(it);
+			if (padding > 0) {
+				block.freeRanges[rangeOffset] = padding;
+			}
+			VkDeviceSize tail = rangeSize - padding - requirements.size;
+			if (tail > 0) {
+				block.freeRanges[alignedOffset + requirements.size] = tail;
+			}
+
+			block.usedBytes += requirements.size;
+			block.allocationCount++;
+			allocation.memory = block.memory;
+			allocation.offset = alignedOffset;
+			allocation.size = requirements.size;
+			allocation.mapped = block.mapped ? static_cast<char*>(block.mapped) + alignedOffset : nullptr;
+			return true;
+		}
+		return false;
+	}
+
+	void releaseRange(MemoryBlock& block, VkDeviceSize offset, VkDeviceSize size) {
+		auto next = block.freeRanges.lower_bound(offset);
+		if (next != block.freeRanges.end() && offset + size == next->first) {
+			size += next->second;
+			next = block.freeRanges.erase(next);
+		}
+		if (next != block.freeRanges.begin()) {
+			auto prev = std::prev(next);
+			if (prev->first + prev->second == offset) {
+				prev->second += size;
+				return;
+			}
+		}
+		block.freeRanges[offset] = size;
+	}
+};
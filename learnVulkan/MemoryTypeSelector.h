@@ -0,0 +1,167 @@
+#pragma once
+
+#include <bitset>
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+#include <vulkan/vulkan_core.h>
+
+uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties, const VkPhysicalDeviceMemoryProperties& memProperties) {
+	for (uint32_t i = 0; i < memProperties.memoryTypeCount;i++) {
+		if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+			return i;
+		}
+	}
+
+	throw std::runtime_error("failed to find suitable memory type");
+}
+
+// What a buffer's memory is for, rather than which property flags it needs.
+enum class MemoryUsage {
+	GpuOnly,	// filled by transfers, only ever read by the GPU
+	Upload,		// written once by the host and read by a transfer (staging)
+	Readback,	// written by the GPU and read back on the host
+	Streaming,	// rewritten by the host every frame and read by shaders in place
+};
+
+struct MemoryHeapBudget {
+	VkDeviceSize budget = 0;
+	VkDeviceSize usage = 0;
+};
+
+// Picks a memory type per usage intent from properties queried once. Types are scored by the preferred
+// flags they miss and the unwanted flags they carry; heaps without room left in their budget are only
+// used when nothing else fits. Budgets come from VK_EXT_memory_budget when the device has it, otherwise
+// from 80% of the heap size against what this process allocated.
+class MemoryTypeSelector {
+public:
+	void init(VkPhysicalDevice physicalDevice, bool memoryBudgetSupported) {
+		this->physicalDevice = physicalDevice;
+		this->memoryBudgetSupported = memoryBudgetSupported;
+		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+		unifiedMemory = true;
+		for (uint32_t i = 0; i < memProperties.memoryHeapCount; i++) {
+			unifiedMemory = unifiedMemory && (memProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT);
+		}
+
+		// without resizable BAR the host visible part of VRAM is a 256 MiB window
+		VkDeviceSize hostVisibleDeviceLocal = 0;
+		for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+			VkMemoryPropertyFlags flags = memProperties.memoryTypes[i].propertyFlags;
+			if ((flags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) && (flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) {
+				hostVisibleDeviceLocal = std::max(hostVisibleDeviceLocal, memProperties.memoryHeaps[memProperties.memoryTypes[i].heapIndex].size);
+			}
+		}
+		resizableBar = !unifiedMemory && hostVisibleDeviceLocal > 256ull * 1024 * 1024;
+
+		updateBudget();
+	}
+
+	const VkPhysicalDeviceMemoryProperties& getProperties() const {
+		return memProperties;
+	}
+
+	bool isUnifiedMemory() const {
+		return unifiedMemory;
+	}
+
+	bool hasResizableBar() const {
+		return resizableBar;
+	}
+
+	// device local memory is host visible at full size, so hot data can be written in place instead of staged
+	bool directDeviceWrites() const {
+		return unifiedMemory || resizableBar;
+	}
+
+	uint32_t select(uint32_t typeBits, MemoryUsage usage, VkDeviceSize size) {
+		if (budgetDirty) {
+			updateBudget();
+		}
+
+		VkMemoryPropertyFlags required = 0, preferred = 0, avoided = 0;
+		switch (usage) {
+		case MemoryUsage::GpuOnly:
+			preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+			avoided = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+			break;
+		case MemoryUsage::Upload:
+			required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+			avoided = VK_MEMORY_PROPERTY_HOST_CACHED_BIT | (unifiedMemory ? 0 : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+			break;
+		case MemoryUsage::Readback:
+			required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+			preferred = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+			break;
+		case MemoryUsage::Streaming:
+			required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+			preferred = directDeviceWrites() ? VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT : 0;
+			avoided = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+			break;
+		}
+
+		uint32_t bestType = UINT32_MAX;
+		size_t bestCost = SIZE_MAX;
+		for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+			VkMemoryPropertyFlags flags = memProperties.memoryTypes[i].propertyFlags;
+			if (!(typeBits & (1u << i)) || (flags & required) != required) continue;
+
+			size_t cost = std::bitset<32>(preferred & ~flags).count() + std::bitset<32>(avoided & flags).count();
+			MemoryHeapBudget heap = getBudget(memProperties.memoryTypes[i].heapIndex);
+			if (heap.usage + size > heap.budget) {
+				cost += 32;
+			}
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestType = i;
+			}
+		}
+		if (bestType == UINT32_MAX) {
+			throw std::runtime_error("failed to find suitable memory type");
+		}
+		return bestType;
+	}
+
+	// called by the allocator around every vkAllocateMemory / vkFreeMemory
+	void trackAllocation(uint32_t heapIndex, VkDeviceSize size, bool freed) {
+		trackedUsage[heapIndex] = freed ? trackedUsage[heapIndex] - size : trackedUsage[heapIndex] + size;
+		budgetDirty = true;
+	}
+
+	MemoryHeapBudget getBudget(uint32_t heapIndex) const {
+		return budgets[heapIndex];
+	}
+
+	void updateBudget() {
+		budgetDirty = false;
+		if (memoryBudgetSupported) {
+			VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{};
+			budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+			VkPhysicalDeviceMemoryProperties2 properties2{};
+			properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+			properties2.pNext = &budgetProperties;
+			vkGetPhysicalDeviceMemoryProperties2(physicalDevice, &properties2);
+			for (uint32_t i = 0; i < memProperties.memoryHeapCount; i++) {
+				budgets[i].budget = budgetProperties.heapBudget[i];
+				budgets[i].usage = budgetProperties.heapUsage[i];
+			}
+			return;
+		}
+		for (uint32_t i = 0; i < memProperties.memoryHeapCount; i++) {
+			budgets[i].budget = memProperties.memoryHeaps[i].size / 10 * 8;
+			budgets[i].usage = trackedUsage[i];
+		}
+	}
+
+private:
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties memProperties{};
+	bool memoryBudgetSupported = false;
+	bool unifiedMemory = false;
+	bool resizableBar = false;
+	bool budgetDirty = false;
+	VkDeviceSize trackedUsage[VK_MAX_MEMORY_HEAPS] = {};
+	MemoryHeapBudget budgets[VK_MAX_MEMORY_HEAPS];
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <vector>
+#include <stdexcept>
+
+#include <vulkan/vulkan_core.h>
+#include "MemoryAllocator.h"
+
+// Color images standing in for the swapchain when there is no surface to present to. Images are handed out
+// round robin; a frame's render pass overwrites whatever the image held, and the subpass dependency on
+// COLOR_ATTACHMENT_OUTPUT orders it after the last frame that rendered into it on the same queue.
+class OffscreenTarget {
+public:
+	void init(VkDevice device, VkPhysicalDevice physicalDevice, DeviceMemoryAllocator& allocator, VkExtent2D extent, uint32_t imageCount, const VkAllocationCallbacks* allocationCallbacks) {
+		this->device = device;
+		this->allocationCallbacks = allocationCallbacks;
+		this->extent = extent;
+		format = chooseFormat(physicalDevice);
+		next = 0;
+
+		images.resize(imageCount);
+		allocations.resize(imageCount);
+		for (uint32_t i = 0; i < imageCount; i++) {
+			VkImageCreateInfo imageInfo{};
+			imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+			imageInfo.imageType = VK_IMAGE_TYPE_2D;
+			imageInfo.format = format;
+			imageInfo.extent = { extent.width, extent.height, 1 };
+			imageInfo.mipLevels = 1;
+			imageInfo.arrayLayers = 1;
+			imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+			imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+			// transfer source so a frame can be read back for inspection
+			imageInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+			imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+			imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			if (vkCreateImage(device, &imageInfo, allocationCallbacks, &images[i]) != VK_SUCCESS) {
+				throw std::runtime_error("failed to create offscreen image!");
+			}
+
+			VkMemoryRequirements memRequirements;
+			vkGetImageMemoryRequirements(device, images[i], &memRequirements);
+			allocations[i] = allocator.allocateImage(memRequirements, MemoryUsage::GpuOnly);
+			if (vkBindImageMemory(device, images[i], allocations[i].memory, allocations[i].offset) != VK_SUCCESS) {
+				throw std::runtime_error("failed to bind offscreen image memory!");
+			}
+		}
+	}
+
+	void destroy(DeviceMemoryAllocator& allocator) {
+		for (size_t i = 0; i < images.size(); i++) {
+			vkDestroyImage(device, images[i], allocationCallbacks);
+			allocator.free(allocations[i]);
+		}
+		images.clear();
+		allocations.clear();
+	}
+
+	const std::vector<VkImage>& getImages() const {
+		return images;
+	}
+
+	VkFormat getFormat() const {
+		return format;
+	}
+
+	VkExtent2D getExtent() const {
+		return extent;
+	}
+
+	uint32_t acquire() {
+		uint32_t imageIndex = next;
+		next = (next + 1) % static_cast<uint32_t>(images.size());
+		return imageIndex;
+	}
+
+private:
+	VkDevice device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks* allocationCallbacks = nullptr;
+	VkFormat format = VK_FORMAT_UNDEFINED;
+	VkExtent2D extent{};
+	std::vector<VkImage> images;
+	std::vector<MemoryAllocation> allocations;
+	uint32_t next = 0;
+
+	// same preference as the swapchain, so the pipeline sees the format it would on screen
+	static VkFormat chooseFormat(VkPhysicalDevice physicalDevice) {
+		for (VkFormat candidate : { VK_FORMAT_B8G8R8A8_SRGB, VK_FORMAT_R8G8B8A8_SRGB, VK_FORMAT_R8G8B8A8_UNORM }) {
+			VkFormatProperties properties;
+			vkGetPhysicalDeviceFormatProperties(physicalDevice, candidate, &properties);
+			if (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT) {
+				return candidate;
+			}
+		}
+		throw std::runtime_error("failed to find an offscreen color format!");
+	}
+};
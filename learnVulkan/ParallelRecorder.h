@@ -0,0 +1,128 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+
+#include <vulkan/vulkan_core.h>
+#include "FrameCommandPool.h"
+#include "JobSystem.h"
+
+// Records a range of draws as secondary command buffers split into chunks that run as jobs. Every job system
+// worker has its own pools per frame slot, and a chunk records from the pools of the worker it runs on, so a
+// pool is never used by two threads at once:
+// - a FrameCommandPool for everything recorded once per frame, reset as a whole by beginFrame
+// - a FrameCommandPool for the static secondaries, which outlive frames so they can be replayed; it is only
+//   reset when the static channel of its slot is recorded again
+class ParallelRecorder {
+public:
+	using RecordRange = std::function<void(VkCommandBuffer commandBuffer, uint32_t firstDraw, uint32_t drawCount)>;
+
+	enum Channel : uint32_t { STATIC_CHANNEL, DYNAMIC_CHANNEL };
+	// below this a chunk costs more to hand out than to record
+	static constexpr uint32_t MIN_DRAWS_PER_CHUNK = 256;
+
+	void init(JobSystem& jobs, VkDevice device, uint32_t queueFamily, VkRenderPass renderPass, uint32_t slotCount, bool perBufferReset, const VkAllocationCallbacks* allocationCallbacks) {
+		this->jobs = &jobs;
+		this->renderPass = renderPass;
+
+		workers.resize(jobs.getThreadCount());
+		for (auto& worker : workers) {
+			worker.slots.resize(slotCount);
+			for (auto& slot : worker.slots) {
+				slot.framePool.init(device, queueFamily, perBufferReset, true, allocationCallbacks);
+				// cached static secondaries are replayed for as long as the scene stays the same
+				slot.staticPool.init(device, queueFamily, perBufferReset, false, allocationCallbacks);
+			}
+		}
+	}
+
+	void destroy() {
+		for (auto& worker : workers) {
+			for (auto& slot : worker.slots) {
+				slot.framePool.destroy();
+				slot.staticPool.destroy();
+			}
+		}
+		workers.clear();
+	}
+
+	uint32_t getThreadCount() const {
+		return static_cast<uint32_t>(workers.size());
+	}
+
+	// Recycles every worker's per-frame buffers of the slot; the frame that last used the slot has to be
+	// complete, and no recording job may be running.
+	void beginFrame(uint32_t slot) {
+		for (auto& worker : workers) {
+			worker.slots[slot].framePool.reset();
+		}
+	}
+
+	// the frame's primary, from the pool of the calling worker, which has to record it as well
+	VkCommandBuffer allocatePrimary(uint32_t slot) {
+		return workers[JobSystem::currentWorker()].slots[slot].framePool.allocatePrimary();
+	}
+
+	// Records drawCount draws into secondaries for this slot and returns them in draw order. Recording the
+	// static channel again invalidates what it returned for the slot last time, which has to be complete.
+	std::vector<VkCommandBuffer> record(uint32_t slot, uint32_t channel, uint32_t drawCount, const RecordRange& recordRange) {
+		uint32_t chunkCount = std::min(getThreadCount(), (drawCount + MIN_DRAWS_PER_CHUNK - 1) / MIN_DRAWS_PER_CHUNK);
+		if (chunkCount == 0) return {};
+
+		if (channel == STATIC_CHANNEL) {
+			for (auto& worker : workers) {
+				worker.slots[slot].staticPool.reset();
+			}
+		}
+		std::vector<VkCommandBuffer> commandBuffers(chunkCount);
+		jobs->parallelFor(chunkCount, 1, [&](uint32_t begin, uint32_t end) {
+			for (uint32_t chunk = begin; chunk < end; chunk++) {
+				uint32_t firstDraw = static_cast<uint32_t>(static_cast<uint64_t>(drawCount) * chunk / chunkCount);
+				uint32_t endDraw = static_cast<uint32_t>(static_cast<uint64_t>(drawCount) * (chunk + 1) / chunkCount);
+				commandBuffers[chunk] = recordChunk(slot, channel, firstDraw, endDraw - firstDraw, recordRange);
+			}
+		});
+		return commandBuffers;
+	}
+
+private:
+	struct WorkerSlot {
+		FrameCommandPool framePool;
+		FrameCommandPool staticPool;
+	};
+
+	struct Worker {
+		std::vector<WorkerSlot> slots;
+	};
+
+	JobSystem* jobs = nullptr;
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	std::vector<Worker> workers;
+
+	VkCommandBuffer recordChunk(uint32_t slot, uint32_t channel, uint32_t firstDraw, uint32_t drawCount, const RecordRange& recordRange) {
+		WorkerSlot& workerSlot = workers[JobSystem::currentWorker()].slots[slot];
+		VkCommandBuffer commandBuffer = channel == STATIC_CHANNEL ? workerSlot.staticPool.allocateSecondary() : workerSlot.framePool.allocateSecondary();
+
+		// no framebuffer: the same secondaries run inside the render pass for whichever image was acquired
+		VkCommandBufferInheritanceInfo inheritanceInfo{};
+		inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritanceInfo.renderPass = renderPass;
+		inheritanceInfo.subpass = 0;
+		inheritanceInfo.framebuffer = VK_NULL_HANDLE;
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+		beginInfo.pInheritanceInfo = &inheritanceInfo;
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+			throw std::runtime_error("failed to begin recording secondary command buffer!");
+		}
+		recordRange(commandBuffer, firstDraw, drawCount);
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record secondary command buffer!");
+		}
+		return commandBuffer;
+	}
+};
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <filesystem>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <vulkan/vulkan_core.h>
+
+// VkPipelineCache persisted to a file between runs. The driver's blob is stored behind a header of our own
+// that names the device and driver it came from and checksums the blob, since drivers differ in how well
+// they cope with data from another driver version or a truncated file. Anything that does not match is
+// dropped and the run starts with an empty cache. Saving writes a temporary file next to the target and
+// renames it over the old one, so a crash mid-write never leaves a partial cache behind. A failed save is
+// only reported: losing the cache costs the next run its warm start, not this run its frames.
+class PipelineCacheFile {
+public:
+	// how the cache started out, for reports
+	enum class LoadResult { Disabled, Loaded, Missing, Reset, Mismatch, Corrupt };
+
+	// an empty path disables the cache: getHandle returns VK_NULL_HANDLE and nothing is saved
+	void init(VkDevice device, VkPhysicalDevice physicalDevice, const std::string& path, bool reset, const VkAllocationCallbacks* allocationCallbacks) {
+		this->device = device;
+		this->path = path;
+		this->allocationCallbacks = allocationCallbacks;
+		if (path.empty()) {
+			loadResult = LoadResult::Disabled;
+			return;
+		}
+
+		VkPhysicalDeviceIDProperties idProperties{};
+		idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+		VkPhysicalDeviceProperties2 properties{};
+		properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties.pNext = &idProperties;
+		vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+		expected = FileHeader{};
+		memcpy(expected.magic, MAGIC, sizeof(expected.magic));
+		expected.fileVersion = FILE_VERSION;
+		expected.vendorID = properties.properties.vendorID;
+		expected.deviceID = properties.properties.deviceID;
+		expected.driverVersion = properties.properties.driverVersion;
+		memcpy(expected.driverUUID, idProperties.driverUUID, VK_UUID_SIZE);
+		memcpy(expected.pipelineCacheUUID, properties.properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+		std::vector<char> data;
+		onDisk = BlobSummary{};
+		loadResult = reset ? LoadResult::Reset : load(data);
+		if (loadResult != LoadResult::Loaded) {
+			data.clear();
+		}
+		loadedBytes = data.size();
+		if (loadResult == LoadResult::Loaded) {
+			onDisk = BlobSummary{ true, data.size(), checksum(data) };
+		}
+
+		VkPipelineCacheCreateInfo cacheInfo{};
+		cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+		cacheInfo.initialDataSize = data.size();
+		cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+		if (vkCreatePipelineCache(device, &cacheInfo, allocationCallbacks, &cache) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create pipeline cache!");
+		}
+		lastSave = std::chrono::steady_clock::now();
+		// a reset cache replaces the old file even if nothing new gets compiled
+		dirty = reset;
+	}
+
+	void destroy() {
+		if (cache != VK_NULL_HANDLE) {
+			vkDestroyPipelineCache(device, cache, allocationCallbacks);
+			cache = VK_NULL_HANDLE;
+		}
+	}
+
+	VkPipelineCache getHandle() const {
+		return cache;
+	}
+
+	LoadResult getLoadResult() const {
+		return loadResult;
+	}
+
+	size_t getLoadedBytes() const {
+		return loadedBytes;
+	}
+
+	static const char* describe(LoadResult result) {
+		switch (result) {
+		case LoadResult::Disabled: return "disabled";
+		case LoadResult::Loaded: return "warm";
+		case LoadResult::Missing: return "cold (no cache file)";
+		case LoadResult::Reset: return "cold (reset)";
+		case LoadResult::Mismatch: return "cold (other device or driver)";
+		case LoadResult::Corrupt: return "cold (corrupt cache file)";
+		}
+		return "unknown";
+	}
+
+	// after creating pipelines through the cache, so the next save checks whether the blob changed
+	void markDirty() {
+		dirty = cache != VK_NULL_HANDLE;
+	}
+
+	// Called every frame; saves at most once per interval, and only after markDirty. The file itself is only
+	// rewritten when the driver's blob differs from what is on disk, so a warm run leaves it alone.
+	void saveIfDue(std::chrono::steady_clock::duration interval) {
+		if (dirty && std::chrono::steady_clock::now() - lastSave >= interval) {
+			save();
+		}
+	}
+
+	// never throws; on failure the old file stays and the cache is tried again at the next save
+	void save() {
+		if (!dirty) return;
+		dirty = false;
+		lastSave = std::chrono::steady_clock::now();
+
+		std::string tempPath = path + ".tmp";
+		try {
+			write(tempPath);
+		}
+		catch (const std::exception& e) {
+			std::cerr << "failed to save pipeline cache: " << e.what() << std::endl;
+			std::error_code ignored;
+			std::filesystem::remove(tempPath, ignored);
+			dirty = true;
+		}
+	}
+
+private:
+	static constexpr char MAGIC[4] = { 'L', 'V', 'P', 'C' };
+	static constexpr uint32_t FILE_VERSION = 1;
+
+	struct FileHeader {
+		char magic[4];
+		uint32_t fileVersion;
+		uint32_t vendorID;
+		uint32_t deviceID;
+		uint32_t driverVersion;
+		uint8_t driverUUID[VK_UUID_SIZE];
+		uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+		uint64_t dataSize;
+		uint64_t checksum;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks* allocationCallbacks = nullptr;
+	std::string path;
+	VkPipelineCache cache = VK_NULL_HANDLE;
+	FileHeader expected{};
+	LoadResult loadResult = LoadResult::Disabled;
+	size_t loadedBytes = 0;
+	bool dirty = false;
+	std::chrono::steady_clock::time_point lastSave;
+	// the blob the file holds, as loaded or last written
+	struct BlobSummary {
+		bool valid = false;
+		size_t size = 0;
+		uint64_t checksum = 0;
+	};
+	BlobSummary onDisk;
+
+	void write(const std::string& tempPath) {
+		size_t size = 0;
+		if (vkGetPipelineCacheData(device, cache, &size, nullptr) != VK_SUCCESS) {
+			throw std::runtime_error("failed to get pipeline cache size!");
+		}
+		std::vector<char> data(size);
+		if (size > 0 && vkGetPipelineCacheData(device, cache, &size, data.data()) != VK_SUCCESS) {
+			throw std::runtime_error("failed to get pipeline cache data!");
+		}
+		data.resize(size);
+
+		FileHeader header = expected;
+		header.dataSize = data.size();
+		header.checksum = checksum(data);
+		if (onDisk.valid && onDisk.size == data.size() && onDisk.checksum == header.checksum) return;
+
+		{
+			std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+			out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+			out.write(data.data(), data.size());
+			out.flush();
+			if (!out) {
+				throw std::runtime_error("failed to write pipeline cache: " + tempPath);
+			}
+		}
+		// replaces an existing file in one step on both Windows and POSIX
+		std::filesystem::rename(tempPath, path);
+		onDisk = BlobSummary{ true, data.size(), header.checksum };
+	}
+
+	LoadResult load(std::vector<char>& data) const {
+		std::ifstream in(path, std::ios::binary);
+		if (!in) return LoadResult::Missing;
+
+		FileHeader header{};
+		if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) return LoadResult::Corrupt;
+		if (memcmp(header.magic, MAGIC, sizeof(header.magic)) != 0 || header.fileVersion != FILE_VERSION) return LoadResult::Corrupt;
+		if (header.vendorID != expected.vendorID || header.deviceID != expected.deviceID || header.driverVersion != expected.driverVersion
+			|| memcmp(header.driverUUID, expected.driverUUID, VK_UUID_SIZE) != 0
+			|| memcmp(header.pipelineCacheUUID, expected.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+			return LoadResult::Mismatch;
+		}
+
+		// the blob is all that follows the header, so a size that disagrees is rejected before allocating for it
+		std::streamoff dataStart = in.tellg();
+		in.seekg(0, std::ios::end);
+		std::streamoff fileEnd = in.tellg();
+		if (dataStart < 0 || fileEnd < dataStart || header.dataSize != static_cast<uint64_t>(fileEnd - dataStart)) return LoadResult::Corrupt;
+		in.seekg(dataStart);
+
+		data.resize(static_cast<size_t>(header.dataSize));
+		if (!in.read(data.data(), data.size()) || checksum(data) != header.checksum) return LoadResult::Corrupt;
+
+		// the driver's own header has to agree as well
+		VkPipelineCacheHeaderVersionOne driverHeader{};
+		if (data.size() < sizeof(driverHeader)) return LoadResult::Corrupt;
+		memcpy(&driverHeader, data.data(), sizeof(driverHeader));
+		if (driverHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE || driverHeader.headerSize < sizeof(driverHeader)) return LoadResult::Corrupt;
+		if (driverHeader.vendorID != expected.vendorID || driverHeader.deviceID != expected.deviceID
+			|| memcmp(driverHeader.pipelineCacheUUID, expected.pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+			return LoadResult::Mismatch;
+		}
+		return LoadResult::Loaded;
+	}
+
+	// FNV-1a
+	static uint64_t checksum(const std::vector<char>& data) {
+		uint64_t hash = 14695981039346656037ull;
+		for (char c : data) {
+			hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+		}
+		return hash;
+	}
+};
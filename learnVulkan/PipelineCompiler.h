@@ -0,0 +1,530 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+
+#include <vulkan/vulkan_core.h>
+#include "JobSystem.h"
+#include "ShaderUtils.h"
+
+// Everything that tells one graphics pipeline of the app apart from another. Viewport and scissor are always
+// dynamic, so pipelines don't depend on the swapchain extent.
+struct PipelineDescription {
+	std::string vertexShader;
+	std::string fragmentShader;
+	VkVertexInputBindingDescription vertexBinding{};
+	std::vector<VkVertexInputAttributeDescription> vertexAttributes;
+	VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+	bool primitiveRestartEnable = false;
+	VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+	VkFrontFace frontFace = VK_FRONT_FACE_CLOCKWISE;
+	bool blendEnable = false;
+	VkColorComponentFlags colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	// specialization constants, applied to both stages
+	std::vector<VkSpecializationMapEntry> specializationEntries;
+	std::vector<uint8_t> specializationData;
+	VkPipelineLayout layout = VK_NULL_HANDLE;
+	VkRenderPass renderPass = VK_NULL_HANDLE;
+	uint32_t subpass = 0;
+};
+
+// Optional device features that take state out of the pipeline; with all of them off every pipeline is one
+// monolithic compile.
+struct PipelineFeatures {
+	// VK_EXT_extended_dynamic_state: cull mode, front face and topology within its class are set while recording
+	bool extendedDynamicState = false;
+	// VK_EXT_extended_dynamic_state2: primitive restart
+	bool extendedDynamicState2 = false;
+	// VK_EXT_extended_dynamic_state3: blend enable and color write mask
+	bool dynamicBlend = false;
+	// VK_EXT_graphics_pipeline_library with graphicsPipelineLibraryFastLinking: pipelines are linked from four
+	// separately compiled parts
+	bool graphicsPipelineLibrary = false;
+};
+
+// the parts VK_EXT_graphics_pipeline_library splits a pipeline into
+enum PipelineLibraryPart : uint32_t {
+	VERTEX_INPUT_PART,
+	PRE_RASTERIZATION_PART,
+	FRAGMENT_SHADER_PART,
+	FRAGMENT_OUTPUT_PART,
+	PIPELINE_LIBRARY_PART_COUNT
+};
+
+struct CompiledPipeline {
+	VkPipeline pipeline = VK_NULL_HANDLE;
+	double compileMs = 0.0;
+};
+
+// handed out by PipelineCompiler::compile; the pipeline is there once the job has finished
+struct PipelineFuture {
+	JobHandle job;
+	std::shared_ptr<CompiledPipeline> result;
+
+	bool isReady() const {
+		return job->finished.load(std::memory_order_acquire);
+	}
+};
+
+// Compiles pipelines as jobs, so many of them build at once on all workers. They all go through the one
+// VkPipelineCache, which the driver synchronizes internally. Shader modules are loaded once per file and
+// shared by every pipeline using them. Created pipelines and libraries belong to the caller. Compiles nobody
+// is about to wait for can be made background jobs, which never run on a worker in the middle of a frame.
+class PipelineCompiler {
+public:
+	// features has to match what the device was created with
+	void init(JobSystem& jobs, VkDevice device, VkPipelineCache cache, const PipelineFeatures& features, const VkAllocationCallbacks* allocationCallbacks) {
+		this->jobs = &jobs;
+		this->device = device;
+		this->cache = cache;
+		this->features = features;
+		this->allocationCallbacks = allocationCallbacks;
+		if (features.extendedDynamicState) {
+			setCullMode = (PFN_vkCmdSetCullModeEXT)vkGetDeviceProcAddr(device, "vkCmdSetCullModeEXT");
+			setFrontFace = (PFN_vkCmdSetFrontFaceEXT)vkGetDeviceProcAddr(device, "vkCmdSetFrontFaceEXT");
+			setPrimitiveTopology = (PFN_vkCmdSetPrimitiveTopologyEXT)vkGetDeviceProcAddr(device, "vkCmdSetPrimitiveTopologyEXT");
+			if (!setCullMode || !setFrontFace || !setPrimitiveTopology) {
+				throw std::runtime_error("failed to load extended dynamic state commands!");
+			}
+		}
+		if (features.extendedDynamicState2) {
+			setPrimitiveRestartEnable = (PFN_vkCmdSetPrimitiveRestartEnableEXT)vkGetDeviceProcAddr(device, "vkCmdSetPrimitiveRestartEnableEXT");
+			if (!setPrimitiveRestartEnable) {
+				throw std::runtime_error("failed to load extended dynamic state 2 commands!");
+			}
+		}
+		if (features.dynamicBlend) {
+			setColorBlendEnable = (PFN_vkCmdSetColorBlendEnableEXT)vkGetDeviceProcAddr(device, "vkCmdSetColorBlendEnableEXT");
+			setColorWriteMask = (PFN_vkCmdSetColorWriteMaskEXT)vkGetDeviceProcAddr(device, "vkCmdSetColorWriteMaskEXT");
+			if (!setColorBlendEnable || !setColorWriteMask) {
+				throw std::runtime_error("failed to load extended dynamic state 3 commands!");
+			}
+		}
+	}
+
+	// every compile has to be finished
+	void destroy() {
+		for (const auto& module : shaderModules) {
+			vkDestroyShaderModule(device, module.second, nullptr);
+		}
+		shaderModules.clear();
+	}
+
+	PipelineFuture compile(const PipelineDescription& description, bool background = false) {
+		PipelineFuture future;
+		future.result = std::make_shared<CompiledPipeline>();
+		future.job = submit(background, [this, description, result = future.result]() {
+			auto start = std::chrono::steady_clock::now();
+			result->pipeline = createPipeline(description);
+			result->compileMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			compiledCount++;
+		});
+		return future;
+	}
+
+	// one part of a pipeline, for linking with link
+	PipelineFuture compileLibrary(const PipelineDescription& description, PipelineLibraryPart part, bool background = false) {
+		PipelineFuture future;
+		future.result = std::make_shared<CompiledPipeline>();
+		future.job = submit(background, [this, description, part, result = future.result]() {
+			auto start = std::chrono::steady_clock::now();
+			result->pipeline = createLibrary(description, part);
+			result->compileMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			libraryCount++;
+		});
+		return future;
+	}
+
+	// Links one library per part, in PipelineLibraryPart order, once they are compiled. Without link time
+	// optimization, which is only quick next to a full compile on devices reporting
+	// graphicsPipelineLibraryFastLinking; libraries are not turned on for any other.
+	PipelineFuture link(const PipelineDescription& description, const std::vector<PipelineFuture>& parts, bool background = false) {
+		PipelineFuture future;
+		future.result = std::make_shared<CompiledPipeline>();
+		std::vector<JobHandle> dependencies;
+		std::vector<std::shared_ptr<CompiledPipeline>> libraries;
+		for (const auto& part : parts) {
+			dependencies.push_back(part.job);
+			libraries.push_back(part.result);
+		}
+		future.job = submit(background, [this, layout = description.layout, libraries, result = future.result]() {
+			auto start = std::chrono::steady_clock::now();
+			result->pipeline = linkLibraries(layout, libraries);
+			result->compileMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			linkedCount++;
+		}, dependencies);
+		return future;
+	}
+
+	// runs other jobs meanwhile, though not background compiles; rethrows if the compile failed
+	VkPipeline wait(const PipelineFuture& future) {
+		jobs->wait({ future.job });
+		return future.result->pipeline;
+	}
+
+	const PipelineFeatures& getFeatures() const {
+		return features;
+	}
+
+	// The description with the state this device sets while recording reset to one value, so descriptions that
+	// only differ in it share a pipeline. Blend factors are baked for blending whenever blend enable is dynamic.
+	PipelineDescription withoutDynamicState(PipelineDescription description) const {
+		if (features.extendedDynamicState) {
+			description.cullMode = VK_CULL_MODE_NONE;
+			description.frontFace = VK_FRONT_FACE_CLOCKWISE;
+			description.topology = topologyClass(description.topology);
+		}
+		if (features.extendedDynamicState2) {
+			description.primitiveRestartEnable = false;
+		}
+		if (features.dynamicBlend) {
+			description.blendEnable = false;
+			description.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+		}
+		return description;
+	}
+
+	// Only the state the given part is built from, so parts shared between pipelines compare equal.
+	static PipelineDescription libraryPart(const PipelineDescription& description, PipelineLibraryPart part) {
+		PipelineDescription ret;
+		switch (part) {
+		case VERTEX_INPUT_PART:
+			ret.vertexBinding = description.vertexBinding;
+			ret.vertexAttributes = description.vertexAttributes;
+			ret.topology = description.topology;
+			ret.primitiveRestartEnable = description.primitiveRestartEnable;
+			return ret;
+		case PRE_RASTERIZATION_PART:
+			ret.vertexShader = description.vertexShader;
+			ret.cullMode = description.cullMode;
+			ret.frontFace = description.frontFace;
+			break;
+		case FRAGMENT_SHADER_PART:
+			ret.fragmentShader = description.fragmentShader;
+			break;
+		case FRAGMENT_OUTPUT_PART:
+			ret.blendEnable = description.blendEnable;
+			ret.colorWriteMask = description.colorWriteMask;
+			ret.renderPass = description.renderPass;
+			ret.subpass = description.subpass;
+			return ret;
+		default:
+			throw std::runtime_error("unknown pipeline library part!");
+		}
+		ret.specializationEntries = description.specializationEntries;
+		ret.specializationData = description.specializationData;
+		ret.layout = description.layout;
+		ret.renderPass = description.renderPass;
+		ret.subpass = description.subpass;
+		return ret;
+	}
+
+	// Sets the state withoutDynamicState took out of the pipeline, after binding the pipeline for description:
+	// descriptions sharing a pipeline differ in exactly this state.
+	void setDynamicState(VkCommandBuffer commandBuffer, const PipelineDescription& description) const {
+		if (features.extendedDynamicState) {
+			setCullMode(commandBuffer, description.cullMode);
+			setFrontFace(commandBuffer, description.frontFace);
+			setPrimitiveTopology(commandBuffer, description.topology);
+		}
+		if (features.extendedDynamicState2) {
+			setPrimitiveRestartEnable(commandBuffer, description.primitiveRestartEnable ? VK_TRUE : VK_FALSE);
+		}
+		if (features.dynamicBlend) {
+			VkBool32 blendEnable = description.blendEnable ? VK_TRUE : VK_FALSE;
+			setColorBlendEnable(commandBuffer, 0, 1, &blendEnable);
+			setColorWriteMask(commandBuffer, 0, 1, &description.colorWriteMask);
+		}
+	}
+
+	// monolithic compiles and linked pipelines
+	uint32_t getCompiledCount() const {
+		return compiledCount.load() + linkedCount.load();
+	}
+
+	uint32_t getLibraryCount() const {
+		return libraryCount.load();
+	}
+
+private:
+	JobSystem* jobs = nullptr;
+	VkDevice device = VK_NULL_HANDLE;
+	VkPipelineCache cache = VK_NULL_HANDLE;
+	PipelineFeatures features;
+	const VkAllocationCallbacks* allocationCallbacks = nullptr;
+	std::mutex shaderMutex;
+	std::map<std::string, VkShaderModule> shaderModules;
+	std::atomic<uint32_t> compiledCount{ 0 };
+	std::atomic<uint32_t> libraryCount{ 0 };
+	std::atomic<uint32_t> linkedCount{ 0 };
+	PFN_vkCmdSetCullModeEXT setCullMode = nullptr;
+	PFN_vkCmdSetFrontFaceEXT setFrontFace = nullptr;
+	PFN_vkCmdSetPrimitiveTopologyEXT setPrimitiveTopology = nullptr;
+	PFN_vkCmdSetPrimitiveRestartEnableEXT setPrimitiveRestartEnable = nullptr;
+	PFN_vkCmdSetColorBlendEnableEXT setColorBlendEnable = nullptr;
+	PFN_vkCmdSetColorWriteMaskEXT setColorWriteMask = nullptr;
+
+	// with dynamic topology, a pipeline may be drawn with any topology of the class it was created with
+	static VkPrimitiveTopology topologyClass(VkPrimitiveTopology topology) {
+		switch (topology) {
+		case VK_PRIMITIVE_TOPOLOGY_POINT_LIST:
+			return VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+		case VK_PRIMITIVE_TOPOLOGY_LINE_LIST:
+		case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP:
+		case VK_PRIMITIVE_TOPOLOGY_LINE_LIST_WITH_ADJACENCY:
+		case VK_PRIMITIVE_TOPOLOGY_LINE_STRIP_WITH_ADJACENCY:
+			return VK_PRIMITIVE_TOPOLOGY_LINE_LIST;
+		case VK_PRIMITIVE_TOPOLOGY_PATCH_LIST:
+			return VK_PRIMITIVE_TOPOLOGY_PATCH_LIST;
+		default:
+			return VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+		}
+	}
+
+	JobHandle submit(bool background, std::function<void()> work, const std::vector<JobHandle>& dependencies = {}) {
+		return background ? jobs->submitBackground(std::move(work), dependencies) : jobs->submit(std::move(work), dependencies);
+	}
+
+	// the file is read and the module created outside the lock, so compiles needing other shaders don't queue up
+	// behind it; when two threads race for the same one, the loser's module is dropped
+	VkShaderModule getShaderModule(const std::string& path) {
+		{
+			std::lock_guard<std::mutex> lock(shaderMutex);
+			auto it = shaderModules.find(path);
+			if (it != shaderModules.end()) {
+				return it->second;
+			}
+		}
+		VkShaderModule module = ShaderUtils::createShaderModule(device, ShaderUtils::readFile(path));
+		std::lock_guard<std::mutex> lock(shaderMutex);
+		auto inserted = shaderModules.emplace(path, module);
+		if (!inserted.second) {
+			vkDestroyShaderModule(device, module, nullptr);
+		}
+		return inserted.first->second;
+	}
+
+	// every create info a description turns into, wired up for a complete pipeline; libraries take their share
+	struct PipelineState {
+		VkSpecializationInfo specializationInfo{};
+		VkPipelineShaderStageCreateInfo shaderStages[2]{};
+		std::vector<VkDynamicState> dynamicStates;
+		VkPipelineDynamicStateCreateInfo dynamicState{};
+		VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+		VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+		VkPipelineViewportStateCreateInfo viewportState{};
+		VkPipelineRasterizationStateCreateInfo rasterizer{};
+		VkPipelineMultisampleStateCreateInfo multisampling{};
+		VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+		VkPipelineColorBlendStateCreateInfo colorBlending{};
+		VkGraphicsPipelineCreateInfo pipelineInfo{};
+	};
+
+	// state points into itself and into description, so neither may move while it is in use
+	void buildState(const PipelineDescription& description, PipelineState& state) {
+		state.specializationInfo.mapEntryCount = static_cast<uint32_t>(description.specializationEntries.size());
+		state.specializationInfo.pMapEntries = description.specializationEntries.data();
+		state.specializationInfo.dataSize = description.specializationData.size();
+		state.specializationInfo.pData = description.specializationData.data();
+		const VkSpecializationInfo* specialization = description.specializationEntries.empty() ? nullptr : &state.specializationInfo;
+
+		// library parts leave out the shaders they don't compile
+		VkPipelineShaderStageCreateInfo* shaderStages = state.shaderStages;
+		shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+		shaderStages[0].module = description.vertexShader.empty() ? VK_NULL_HANDLE : getShaderModule(description.vertexShader);
+		shaderStages[0].pName = "main";
+		shaderStages[0].pSpecializationInfo = specialization;
+		shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+		shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+		shaderStages[1].module = description.fragmentShader.empty() ? VK_NULL_HANDLE : getShaderModule(description.fragmentShader);
+		shaderStages[1].pName = "main";
+		shaderStages[1].pSpecializationInfo = specialization;
+
+		state.dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+		if (features.extendedDynamicState) {
+			state.dynamicStates.insert(state.dynamicStates.end(), { VK_DYNAMIC_STATE_CULL_MODE, VK_DYNAMIC_STATE_FRONT_FACE, VK_DYNAMIC_STATE_PRIMITIVE_TOPOLOGY });
+		}
+		if (features.extendedDynamicState2) {
+			state.dynamicStates.push_back(VK_DYNAMIC_STATE_PRIMITIVE_RESTART_ENABLE);
+		}
+		if (features.dynamicBlend) {
+			state.dynamicStates.insert(state.dynamicStates.end(), { VK_DYNAMIC_STATE_COLOR_BLEND_ENABLE_EXT, VK_DYNAMIC_STATE_COLOR_WRITE_MASK_EXT });
+		}
+		state.dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+		state.dynamicState.dynamicStateCount = static_cast<uint32_t>(state.dynamicStates.size());
+		state.dynamicState.pDynamicStates = state.dynamicStates.data();
+
+		VkPipelineVertexInputStateCreateInfo& vertexInputInfo = state.vertexInputInfo;
+		vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+		vertexInputInfo.vertexBindingDescriptionCount = 1;
+		vertexInputInfo.pVertexBindingDescriptions = &description.vertexBinding;
+		vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(description.vertexAttributes.size());
+		vertexInputInfo.pVertexAttributeDescriptions = description.vertexAttributes.data();
+
+		VkPipelineInputAssemblyStateCreateInfo& inputAssembly = state.inputAssembly;
+		inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+		inputAssembly.topology = description.topology;
+		inputAssembly.primitiveRestartEnable = description.primitiveRestartEnable ? VK_TRUE : VK_FALSE;
+
+		VkPipelineViewportStateCreateInfo& viewportState = state.viewportState;
+		viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+		viewportState.viewportCount = 1;
+		viewportState.scissorCount = 1;
+
+		VkPipelineRasterizationStateCreateInfo& rasterizer = state.rasterizer;
+		rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+		rasterizer.depthClampEnable = VK_FALSE;
+		rasterizer.rasterizerDiscardEnable = VK_FALSE;
+		rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+		rasterizer.lineWidth = 1.0f;
+		rasterizer.cullMode = description.cullMode;
+		rasterizer.frontFace = description.frontFace;
+		rasterizer.depthBiasEnable = VK_FALSE;
+
+		VkPipelineMultisampleStateCreateInfo& multisampling = state.multisampling;
+		multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+		multisampling.sampleShadingEnable = VK_FALSE;
+		multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+		multisampling.minSampleShading = 1.0f;
+
+		bool blendFactors = description.blendEnable || features.dynamicBlend;
+		VkPipelineColorBlendAttachmentState& colorBlendAttachment = state.colorBlendAttachment;
+		colorBlendAttachment.colorWriteMask = description.colorWriteMask;
+		colorBlendAttachment.blendEnable = description.blendEnable ? VK_TRUE : VK_FALSE;
+		colorBlendAttachment.srcColorBlendFactor = blendFactors ? VK_BLEND_FACTOR_SRC_ALPHA : VK_BLEND_FACTOR_ONE;
+		colorBlendAttachment.dstColorBlendFactor = blendFactors ? VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA : VK_BLEND_FACTOR_ZERO;
+		colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+		colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+		colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+		VkPipelineColorBlendStateCreateInfo& colorBlending = state.colorBlending;
+		colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+		colorBlending.logicOpEnable = VK_FALSE;
+		colorBlending.logicOp = VK_LOGIC_OP_COPY;
+		colorBlending.attachmentCount = 1;
+		colorBlending.pAttachments = &colorBlendAttachment;
+
+		VkGraphicsPipelineCreateInfo& pipelineInfo = state.pipelineInfo;
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		pipelineInfo.stageCount = 2;
+		pipelineInfo.pStages = shaderStages;
+		pipelineInfo.pVertexInputState = &vertexInputInfo;
+		pipelineInfo.pInputAssemblyState = &inputAssembly;
+		pipelineInfo.pViewportState = &viewportState;
+		pipelineInfo.pRasterizationState = &rasterizer;
+		pipelineInfo.pMultisampleState = &multisampling;
+		pipelineInfo.pDepthStencilState = nullptr;
+		pipelineInfo.pColorBlendState = &colorBlending;
+		pipelineInfo.pDynamicState = &state.dynamicState;
+		pipelineInfo.layout = description.layout;
+		pipelineInfo.renderPass = description.renderPass;
+		pipelineInfo.subpass = description.subpass;
+		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+		pipelineInfo.basePipelineIndex = -1;
+	}
+
+	VkPipeline createPipeline(const PipelineDescription& description) {
+		PipelineState state;
+		buildState(description, state);
+		VkPipeline pipeline;
+		if (vkCreateGraphicsPipelines(device, cache, 1, &state.pipelineInfo, allocationCallbacks, &pipeline) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create graphics pipeline!");
+		}
+		return pipeline;
+	}
+
+	// the dynamic state list goes to every part; each only takes the states belonging to it
+	VkPipeline createLibrary(const PipelineDescription& description, PipelineLibraryPart part) {
+		PipelineState state;
+		buildState(description, state);
+		VkGraphicsPipelineCreateInfo& pipelineInfo = state.pipelineInfo;
+		switch (part) {
+		case VERTEX_INPUT_PART:
+			pipelineInfo.stageCount = 0;
+			pipelineInfo.pStages = nullptr;
+			pipelineInfo.pViewportState = nullptr;
+			pipelineInfo.pRasterizationState = nullptr;
+			pipelineInfo.pMultisampleState = nullptr;
+			pipelineInfo.pColorBlendState = nullptr;
+			pipelineInfo.layout = VK_NULL_HANDLE;
+			pipelineInfo.renderPass = VK_NULL_HANDLE;
+			break;
+		case PRE_RASTERIZATION_PART:
+			pipelineInfo.stageCount = 1;
+			pipelineInfo.pVertexInputState = nullptr;
+			pipelineInfo.pInputAssemblyState = nullptr;
+			pipelineInfo.pMultisampleState = nullptr;
+			pipelineInfo.pColorBlendState = nullptr;
+			break;
+		case FRAGMENT_SHADER_PART:
+			pipelineInfo.stageCount = 1;
+			pipelineInfo.pStages = &state.shaderStages[1];
+			pipelineInfo.pVertexInputState = nullptr;
+			pipelineInfo.pInputAssemblyState = nullptr;
+			pipelineInfo.pViewportState = nullptr;
+			pipelineInfo.pRasterizationState = nullptr;
+			pipelineInfo.pColorBlendState = nullptr;
+			break;
+		case FRAGMENT_OUTPUT_PART:
+			pipelineInfo.stageCount = 0;
+			pipelineInfo.pStages = nullptr;
+			pipelineInfo.pVertexInputState = nullptr;
+			pipelineInfo.pInputAssemblyState = nullptr;
+			pipelineInfo.pViewportState = nullptr;
+			pipelineInfo.pRasterizationState = nullptr;
+			pipelineInfo.layout = VK_NULL_HANDLE;
+			break;
+		default:
+			throw std::runtime_error("unknown pipeline library part!");
+		}
+		const VkGraphicsPipelineLibraryFlagsEXT partFlags[PIPELINE_LIBRARY_PART_COUNT] = {
+			VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT,
+			VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT,
+			VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT,
+			VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT,
+		};
+		VkGraphicsPipelineLibraryCreateInfoEXT libraryInfo{};
+		libraryInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT;
+		libraryInfo.flags = partFlags[part];
+		pipelineInfo.pNext = &libraryInfo;
+		pipelineInfo.flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR;
+
+		VkPipeline library;
+		if (vkCreateGraphicsPipelines(device, cache, 1, &pipelineInfo, allocationCallbacks, &library) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create graphics pipeline library!");
+		}
+		return library;
+	}
+
+	VkPipeline linkLibraries(VkPipelineLayout layout, const std::vector<std::shared_ptr<CompiledPipeline>>& parts) {
+		std::vector<VkPipeline> libraries;
+		for (const auto& part : parts) {
+			libraries.push_back(part->pipeline);
+		}
+		VkPipelineLibraryCreateInfoKHR libraryInfo{};
+		libraryInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR;
+		libraryInfo.libraryCount = static_cast<uint32_t>(libraries.size());
+		libraryInfo.pLibraries = libraries.data();
+
+		VkGraphicsPipelineCreateInfo pipelineInfo{};
+		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+		pipelineInfo.pNext = &libraryInfo;
+		pipelineInfo.layout = layout;
+		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+		pipelineInfo.basePipelineIndex = -1;
+
+		VkPipeline pipeline;
+		if (vkCreateGraphicsPipelines(device, cache, 1, &pipelineInfo, allocationCallbacks, &pipeline) != VK_SUCCESS) {
+			throw std::runtime_error("failed to link graphics pipeline!");
+		}
+		return pipeline;
+	}
+};
@@ -0,0 +1,322 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <algorithm>
+#include <stdexcept>
+
+#include <vulkan/vulkan_core.h>
+#include "PipelineCompiler.h"
+
+// Immutable identity of a pipeline's state, hashed once on construction. Two keys are equal when every piece
+// of state that goes into the pipeline is, so equal keys can share one VkPipeline. Layout and render pass are
+// compared by handle.
+class PipelineKey {
+public:
+	explicit PipelineKey(PipelineDescription description) : description(std::move(description)) {
+		hash = computeHash(this->description);
+	}
+
+	const PipelineDescription& getDescription() const {
+		return description;
+	}
+
+	size_t getHash() const {
+		return hash;
+	}
+
+	bool operator==(const PipelineKey& other) const {
+		const PipelineDescription& a = description;
+		const PipelineDescription& b = other.description;
+		return hash == other.hash
+			&& a.vertexShader == b.vertexShader && a.fragmentShader == b.fragmentShader
+			&& a.vertexBinding.binding == b.vertexBinding.binding && a.vertexBinding.stride == b.vertexBinding.stride
+			&& a.vertexBinding.inputRate == b.vertexBinding.inputRate
+			&& a.vertexAttributes.size() == b.vertexAttributes.size()
+			&& std::equal(a.vertexAttributes.begin(), a.vertexAttributes.end(), b.vertexAttributes.begin(), sameAttribute)
+			&& a.topology == b.topology && a.primitiveRestartEnable == b.primitiveRestartEnable && a.cullMode == b.cullMode && a.frontFace == b.frontFace
+			&& a.blendEnable == b.blendEnable && a.colorWriteMask == b.colorWriteMask
+			&& a.specializationEntries.size() == b.specializationEntries.size()
+			&& std::equal(a.specializationEntries.begin(), a.specializationEntries.end(), b.specializationEntries.begin(), sameEntry)
+			&& a.specializationData == b.specializationData
+			&& a.layout == b.layout && a.renderPass == b.renderPass && a.subpass == b.subpass;
+	}
+
+	struct Hasher {
+		size_t operator()(const PipelineKey& key) const {
+			return key.getHash();
+		}
+	};
+
+private:
+	PipelineDescription description;
+	size_t hash = 0;
+
+	static bool sameAttribute(const VkVertexInputAttributeDescription& a, const VkVertexInputAttributeDescription& b) {
+		return a.location == b.location && a.binding == b.binding && a.format == b.format && a.offset == b.offset;
+	}
+
+	static bool sameEntry(const VkSpecializationMapEntry& a, const VkSpecializationMapEntry& b) {
+		return a.constantID == b.constantID && a.offset == b.offset && a.size == b.size;
+	}
+
+	// FNV-1a over every field, one value at a time so padding never gets in
+	struct Fnv {
+		uint64_t value = 14695981039346656037ull;
+
+		void bytes(const void* data, size_t size) {
+			const uint8_t* p = static_cast<const uint8_t*>(data);
+			for (size_t i = 0; i < size; i++) {
+				value = (value ^ p[i]) * 1099511628211ull;
+			}
+		}
+
+		template<typename T>
+		void add(const T& field) {
+			bytes(&field, sizeof(field));
+		}
+
+		void add(const std::string& field) {
+			add(field.size());
+			bytes(field.data(), field.size());
+		}
+	};
+
+	static size_t computeHash(const PipelineDescription& description) {
+		Fnv fnv;
+		fnv.add(description.vertexShader);
+		fnv.add(description.fragmentShader);
+		fnv.add(description.vertexBinding.binding);
+		fnv.add(description.vertexBinding.stride);
+		fnv.add(description.vertexBinding.inputRate);
+		fnv.add(description.vertexAttributes.size());
+		for (const auto& attribute : description.vertexAttributes) {
+			fnv.add(attribute.location);
+			fnv.add(attribute.binding);
+			fnv.add(attribute.format);
+			fnv.add(attribute.offset);
+		}
+		fnv.add(description.topology);
+		fnv.add(description.primitiveRestartEnable);
+		fnv.add(description.cullMode);
+		fnv.add(description.frontFace);
+		fnv.add(description.blendEnable);
+		fnv.add(description.colorWriteMask);
+		fnv.add(description.specializationEntries.size());
+		for (const auto& entry : description.specializationEntries) {
+			fnv.add(entry.constantID);
+			fnv.add(entry.offset);
+			fnv.add(entry.size);
+		}
+		fnv.add(description.specializationData.size());
+		fnv.bytes(description.specializationData.data(), description.specializationData.size());
+		fnv.add(description.layout);
+		fnv.add(description.renderPass);
+		fnv.add(description.subpass);
+		return static_cast<size_t>(fnv.value);
+	}
+};
+
+using PipelineId = uint32_t;
+
+struct PipelineRegistryStats {
+	uint32_t requests = 0;
+	uint32_t unique = 0;
+	uint32_t created = 0;
+	// distinct pipeline library parts, when pipelines are linked from them
+	uint32_t libraries = 0;
+	// pipelines asked for through tryGet before they were ready; a blocking get would have stalled a frame each
+	uint32_t hitchesAvoided = 0;
+	// frames in which at least one wanted pipeline was still compiling
+	uint64_t fallbackFrames = 0;
+};
+
+// Hands out one PipelineId per distinct PipelineKey, however often the same state is requested, and creates
+// the pipeline through the compiler the first time it is needed. State the device sets while recording is
+// left out of the key, and with pipeline libraries each part is compiled once and shared by every pipeline
+// linked from it. prefetch starts compiles early so they run
+// in parallel; get blocks until the pipeline exists, while tryGet never blocks and leaves it to the caller
+// to draw with something else until it does. Compiles started by prefetch and tryGet are background jobs,
+// so a worker waiting on frame work never runs one inline; get waits for those and compiles anything not
+// started yet right away. Safe to use from any job system worker.
+class PipelineRegistry {
+public:
+	void init(PipelineCompiler& compiler, VkDevice device, const VkAllocationCallbacks* allocationCallbacks) {
+		this->compiler = &compiler;
+		this->device = device;
+		this->allocationCallbacks = allocationCallbacks;
+	}
+
+	// collects prefetched pipelines nobody asked for, so they are destroyed as well
+	void destroy() {
+		for (const auto& entry : entries) {
+			VkPipeline pipeline = entry.pipeline;
+			if (pipeline == VK_NULL_HANDLE && entry.started) {
+				pipeline = waitQuietly(entry.future);
+			}
+			if (pipeline != VK_NULL_HANDLE) {
+				vkDestroyPipeline(device, pipeline, allocationCallbacks);
+			}
+		}
+		// linked pipelines don't need their libraries any more
+		for (auto& parts : libraries) {
+			for (const auto& library : parts) {
+				VkPipeline pipeline = waitQuietly(library.second);
+				if (pipeline != VK_NULL_HANDLE) {
+					vkDestroyPipeline(device, pipeline, allocationCallbacks);
+				}
+			}
+			parts.clear();
+		}
+		entries.clear();
+		ids.clear();
+		stats = PipelineRegistryStats{};
+	}
+
+	PipelineId request(const PipelineDescription& description) {
+		std::lock_guard<std::mutex> lock(mutex);
+		stats.requests++;
+		auto inserted = ids.emplace(PipelineKey(compiler->withoutDynamicState(description)), static_cast<PipelineId>(entries.size()));
+		if (inserted.second) {
+			Entry entry;
+			entry.key = &inserted.first->first;
+			entries.push_back(entry);
+			stats.unique++;
+		}
+		return inserted.first->second;
+	}
+
+	// once per frame, before recording: picks up compiles that finished in the background, which bumps the
+	// version so commands recorded without them are recorded again
+	void beginFrame(uint64_t frame) {
+		std::lock_guard<std::mutex> lock(mutex);
+		currentFrame = frame;
+		for (auto& entry : entries) {
+			if (entry.started && entry.pipeline == VK_NULL_HANDLE && entry.future.isReady()) {
+				// already finished, so this only rethrows a failed compile
+				collect(entry, compiler->wait(entry.future));
+			}
+		}
+		for (const auto& entry : entries) {
+			if (entry.wanted && entry.pipeline == VK_NULL_HANDLE) {
+				countFallbackFrame();
+				break;
+			}
+		}
+	}
+
+	void prefetch(PipelineId id) {
+		std::lock_guard<std::mutex> lock(mutex);
+		start(entries[id], true);
+	}
+
+	VkPipeline get(PipelineId id) {
+		PipelineFuture future;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			Entry& entry = entries[id];
+			if (entry.pipeline != VK_NULL_HANDLE) {
+				return entry.pipeline;
+			}
+			start(entry, false);
+			future = entry.future;
+		}
+		// not under the lock: waiting runs other jobs, which may use the registry themselves
+		VkPipeline pipeline = compiler->wait(future);
+		std::lock_guard<std::mutex> lock(mutex);
+		collect(entries[id], pipeline);
+		return pipeline;
+	}
+
+	// the pipeline if it is ready; otherwise starts compiling it in the background and returns VK_NULL_HANDLE
+	VkPipeline tryGet(PipelineId id) {
+		std::lock_guard<std::mutex> lock(mutex);
+		Entry& entry = entries[id];
+		if (entry.pipeline != VK_NULL_HANDLE) {
+			return entry.pipeline;
+		}
+		start(entry, true);
+		if (!entry.wanted) {
+			entry.wanted = true;
+			stats.hitchesAvoided++;
+		}
+		countFallbackFrame();
+		return VK_NULL_HANDLE;
+	}
+
+	// bumped whenever a pipeline is created, for anything caching commands that bind them
+	uint64_t getVersion() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return stats.created;
+	}
+
+	PipelineRegistryStats getStats() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return stats;
+	}
+
+private:
+	struct Entry {
+		// points into ids, whose nodes never move
+		const PipelineKey* key = nullptr;
+		bool started = false;
+		bool wanted = false;
+		PipelineFuture future;
+		VkPipeline pipeline = VK_NULL_HANDLE;
+	};
+
+	PipelineCompiler* compiler = nullptr;
+	VkDevice device = VK_NULL_HANDLE;
+	const VkAllocationCallbacks* allocationCallbacks = nullptr;
+	std::mutex mutex;
+	std::unordered_map<PipelineKey, PipelineId, PipelineKey::Hasher> ids;
+	std::vector<Entry> entries;
+	std::unordered_map<PipelineKey, PipelineFuture, PipelineKey::Hasher> libraries[PIPELINE_LIBRARY_PART_COUNT];
+	PipelineRegistryStats stats;
+	uint64_t currentFrame = 0;
+	uint64_t lastFallbackFrame = UINT64_MAX;
+
+	void collect(Entry& entry, VkPipeline pipeline) {
+		if (entry.pipeline != VK_NULL_HANDLE) return;
+		entry.pipeline = pipeline;
+		stats.created++;
+	}
+
+	void countFallbackFrame() {
+		if (lastFallbackFrame == currentFrame) return;
+		lastFallbackFrame = currentFrame;
+		stats.fallbackFrames++;
+	}
+
+	void start(Entry& entry, bool background) {
+		if (entry.started) return;
+		entry.started = true;
+		const PipelineDescription& description = entry.key->getDescription();
+		if (!compiler->getFeatures().graphicsPipelineLibrary) {
+			entry.future = compiler->compile(description, background);
+			return;
+		}
+		std::vector<PipelineFuture> parts;
+		for (uint32_t i = 0; i < PIPELINE_LIBRARY_PART_COUNT; i++) {
+			PipelineLibraryPart part = static_cast<PipelineLibraryPart>(i);
+			auto inserted = libraries[part].emplace(PipelineKey(PipelineCompiler::libraryPart(description, part)), PipelineFuture{});
+			if (inserted.second) {
+				inserted.first->second = compiler->compileLibrary(inserted.first->first.getDescription(), part, background);
+				stats.libraries++;
+			}
+			parts.push_back(inserted.first->second);
+		}
+		entry.future = compiler->link(description, parts, background);
+	}
+
+	VkPipeline waitQuietly(const PipelineFuture& future) {
+		try {
+			return compiler->wait(future);
+		}
+		catch (const std::exception&) {
+			return VK_NULL_HANDLE;
+		}
+	}
+};
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include <vulkan/vulkan_core.h>
+#include "CustomQueueUtils.h"
+#include "MemoryAllocator.h"
+#include "BufferUtils.h"
+#include "TimelineSemaphore.h"
+
+struct StagingAllocation {
+	VkBuffer buffer = VK_NULL_HANDLE;
+	VkDeviceSize offset = 0;
+	void* mapped = nullptr;
+};
+
+struct StagingStats {
+	VkDeviceSize bytesStaged = 0;
+	uint32_t regionWaits = 0;
+	double stageSeconds = 0.0;
+
+	double megabytesPerSecond() const {
+		return stageSeconds > 0.0 ? bytesStaged / (1024.0 * 1024.0) / stageSeconds : 0.0;
+	}
+};
+
+// One persistently mapped HOST_VISIBLE buffer, cut into equally sized regions that are filled front to back.
+// Every region remembers the transfer timeline value of the last copy that read from it and is only reused
+// once that value has been reached, so uploads never create, map or free anything.
+class StagingRing {
+public:
+	void init(VkDevice device, TimelineSemaphore& transferTimeline, DeviceMemoryAllocator& allocator, VkDeviceSize regionSize, uint32_t regionCount) {
+		this->device = device;
+		this->transferTimeline = &transferTimeline;
+		this->regionSize = regionSize;
+
+		createBuffer(regionSize * regionCount, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MemoryUsage::Upload, buffer, bufferAllocation, device, allocator);
+		regions.resize(regionCount);
+	}
+
+	void destroy(DeviceMemoryAllocator& allocator) {
+		regions.clear();
+		destroyBuffer(buffer, bufferAllocation, device, allocator);
+	}
+
+	VkDeviceSize getRegionSize() const {
+		return regionSize;
+	}
+
+	const StagingStats& getStats() const {
+		return stats;
+	}
+
+	// false when allocate() would have to move on to the next region
+	bool fitsInCurrentRegion(VkDeviceSize size, VkDeviceSize alignment = 16) const {
+		return alignUp(regions[current].head, alignment) + size <= regionSize;
+	}
+
+	StagingAllocation allocate(VkDeviceSize size, VkDeviceSize alignment = 16) {
+		if (size > regionSize) {
+			throw std::runtime_error("staging allocation larger than a ring region");
+		}
+
+		VkDeviceSize offset = alignUp(regions[current].head, alignment);
+		if (offset + size > regionSize) {
+			endRegion();
+			offset = 0;
+		}
+		regions[current].head = offset + size;
+
+		StagingAllocation allocation{};
+		allocation.buffer = buffer;
+		allocation.offset = current * regionSize + offset;
+		allocation.mapped = static_cast<char*>(bufferAllocation.mapped) + allocation.offset;
+		return allocation;
+	}
+
+	StagingAllocation stage(const void* data, VkDeviceSize size) {
+		auto start = std::chrono::high_resolution_clock::now();
+		StagingAllocation allocation = allocate(size);
+		memcpy(allocation.mapped, data, (size_t)size);
+		stats.bytesStaged += size;
+		stats.stageSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+		return allocation;
+	}
+
+	// the submission signalling value is the last one reading from the current region
+	void retire(uint64_t value) {
+		regions[current].retireValue = value;
+	}
+
+	// Called once per frame and whenever a region runs full. Only blocks when the GPU is a whole ring behind.
+	void endRegion() {
+		current = (current + 1) % static_cast<uint32_t>(regions.size());
+		Region& next = regions[current];
+		if (!transferTimeline->isComplete(next.retireValue)) {
+			stats.regionWaits++;
+			transferTimeline->wait(next.retireValue);
+		}
+		next.head = 0;
+	}
+
+private:
+	struct Region {
+		VkDeviceSize head = 0;
+		uint64_t retireValue = 0;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	TimelineSemaphore* transferTimeline = nullptr;
+	VkBuffer buffer = VK_NULL_HANDLE;
+	MemoryAllocation bufferAllocation;
+	VkDeviceSize regionSize = 0;
+	std::vector<Region> regions;
+	uint32_t current = 0;
+	StagingStats stats;
+};
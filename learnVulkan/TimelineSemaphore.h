@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+
+#include <vulkan/vulkan_core.h>
+
+// Monotonic GPU progress counter. Submissions signal increasing values, the host can poll or wait for
+// any value, and other queues can wait on a value without a CPU round-trip.
+class TimelineSemaphore {
+public:
+	void create(VkDevice device, uint64_t initialValue = 0) {
+		this->device = device;
+
+		VkSemaphoreTypeCreateInfo typeInfo{};
+		typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+		typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+		typeInfo.initialValue = initialValue;
+
+		VkSemaphoreCreateInfo semaphoreInfo{};
+		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+		semaphoreInfo.pNext = &typeInfo;
+		if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create timeline semaphore!");
+		}
+		lastSignaled = initialValue;
+		lastCompleted = initialValue;
+	}
+
+	void destroy() {
+		vkDestroySemaphore(device, semaphore, nullptr);
+		semaphore = VK_NULL_HANDLE;
+	}
+
+	VkSemaphore handle() const {
+		return semaphore;
+	}
+
+	// value the next submission should signal
+	uint64_t nextValue() {
+		return ++lastSignaled;
+	}
+
+	uint64_t lastSignaledValue() const {
+		return lastSignaled;
+	}
+
+	uint64_t completedValue() {
+		vkGetSemaphoreCounterValue(device, semaphore, &lastCompleted);
+		return lastCompleted;
+	}
+
+	bool isComplete(uint64_t value) {
+		return value <= lastCompleted || value <= completedValue();
+	}
+
+	// returns false only when the timeout expired
+	bool wait(uint64_t value, uint64_t timeout = UINT64_MAX) {
+		if (value <= lastCompleted) return true;
+
+		VkSemaphoreWaitInfo waitInfo{};
+		waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+		waitInfo.semaphoreCount = 1;
+		waitInfo.pSemaphores = &semaphore;
+		waitInfo.pValues = &value;
+		VkResult res = vkWaitSemaphores(device, &waitInfo, timeout);
+		if (res == VK_TIMEOUT) return false;
+		if (res != VK_SUCCESS) {
+			throw std::runtime_error("failed to wait for timeline semaphore!");
+		}
+		lastCompleted = std::max(lastCompleted, value);
+		return true;
+	}
+
+private:
+	VkDevice device = VK_NULL_HANDLE;
+	VkSemaphore semaphore = VK_NULL_HANDLE;
+	uint64_t lastSignaled = 0;
+	uint64_t lastCompleted = 0;
+};
@@ -0,0 +1,314 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <iterator>
+#include <unordered_map>
+#include <algorithm>
+#include <stdexcept>
+
+#include <vulkan/vulkan_core.h>
+#include "CustomQueueUtils.h"
+#include "StagingRing.h"
+#include "TimelineSemaphore.h"
+
+// Where uploaded buffers are first read on the graphics queue. Submits waiting on an upload ticket wait at
+// these stages, and queue family acquire barriers chain off them.
+constexpr VkPipelineStageFlags UPLOAD_CONSUMER_STAGES = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+constexpr VkAccessFlags UPLOAD_CONSUMER_ACCESS = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+
+// Completion handle for an upload: the transfer timeline value its copy signals. Other queues wait on it
+// on the GPU, the host only needs it to reason about lifetimes.
+struct UploadTicket {
+	uint64_t value = 0;
+};
+
+struct UploadStats {
+	uint64_t uploads = 0;
+	uint64_t submits = 0;
+	uint64_t copyRegions = 0;
+	VkDeviceSize bytes = 0;
+};
+
+// Non-blocking replacement for copyBuffer. Data is staged through the ring right away, but the copies are
+// only queued: flush() records everything queued so far into one command buffer, merging copies that are
+// contiguous in both staging and destination memory, and submits it once. A batch never spans more than one
+// ring region, so it is flushed early when the region runs full or a copy would overlap a queued one.
+// Command buffers are recycled once their value is reached.
+// Buffers are EXCLUSIVE, so when the transfer family differs from the graphics family every copied range is
+// released at the end of its batch and the graphics queue must acquire it with recordAcquireBarriers().
+class TransferUploader {
+public:
+	void init(VkDevice device, VkQueue transferQueue, VkCommandPool transferCommandPool, StagingRing& stagingRing, TimelineSemaphore& transferTimeline, QueueFamilyIndices queueFamilyIndices) {
+		this->device = device;
+		this->transferFamily = queueFamilyIndices.transferFamily.value();
+		this->graphicsFamily = queueFamilyIndices.graphicsFamily.value();
+		this->transferQueue = transferQueue;
+		this->transferCommandPool = transferCommandPool;
+		this->stagingRing = &stagingRing;
+		this->transferTimeline = &transferTimeline;
+	}
+
+	void destroy() {
+		flush();
+		transferTimeline->wait(transferTimeline->lastSignaledValue());
+		recycleCommandBuffers();
+		if (!freeCommandBuffers.empty()) {
+			vkFreeCommandBuffers(device, transferCommandPool, static_cast<uint32_t>(freeCommandBuffers.size()), freeCommandBuffers.data());
+		}
+		freeCommandBuffers.clear();
+	}
+
+	// The returned ticket is the value the batch holding this copy will signal. It can be waited on only
+	// after the batch is flushed; lastSubmittedTicket() never hands out an unflushed value.
+	UploadTicket upload(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size) {
+		const char* bytes = static_cast<const char*>(data);
+		for (VkDeviceSize offset = 0; offset < size; offset += stagingRing->getRegionSize()) {
+			VkDeviceSize chunk = std::min(stagingRing->getRegionSize(), size - offset);
+			if (!stagingRing->fitsInCurrentRegion(chunk) || overlapsPending(dstBuffer, dstOffset + offset, chunk)) {
+				flush();
+			}
+			StagingAllocation staging = stagingRing->stage(bytes + offset, chunk);
+			stagingBuffer = staging.buffer;
+
+			VkBufferCopy copyRegion{};
+			copyRegion.srcOffset = staging.offset;
+			copyRegion.dstOffset = dstOffset + offset;
+			copyRegion.size = chunk;
+			pendingCopies.push_back(PendingCopy{ dstBuffer, copyRegion });
+			pendingRanges[dstBuffer][copyRegion.dstOffset] = copyRegion.dstOffset + chunk;
+		}
+		stats.uploads++;
+		stats.bytes += size;
+		return UploadTicket{ transferTimeline->lastSignaledValue() + (pendingCopies.empty() ? 0 : 1) };
+	}
+
+	// Records and submits every queued copy. Called once per frame and before anything waits on a ticket.
+	void flush() {
+		if (pendingCopies.empty()) return;
+
+		// group by destination and order by offset so neighbours can be merged into one region
+		std::stable_sort(pendingCopies.begin(), pendingCopies.end(), [](const PendingCopy& a, const PendingCopy& b) {
+			return a.dstBuffer != b.dstBuffer ? a.dstBuffer < b.dstBuffer : a.region.dstOffset < b.region.dstOffset;
+		});
+
+		VkCommandBuffer commandBuffer = acquireCommandBuffer();
+
+		VkCommandBufferBeginInfo beginInfo{};
+		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+		size_t first = 0;
+		while (first < pendingCopies.size()) {
+			VkBuffer dstBuffer = pendingCopies[first].dstBuffer;
+			copyRegions.clear();
+			size_t i = first;
+			for (; i < pendingCopies.size() && pendingCopies[i].dstBuffer == dstBuffer; i++) {
+				const VkBufferCopy& region = pendingCopies[i].region;
+				if (!copyRegions.empty()) {
+					VkBufferCopy& last = copyRegions.back();
+					if (last.srcOffset + last.size == region.srcOffset && last.dstOffset + last.size == region.dstOffset) {
+						last.size += region.size;
+						continue;
+					}
+				}
+				copyRegions.push_back(region);
+			}
+			vkCmdCopyBuffer(commandBuffer, stagingBuffer, dstBuffer, static_cast<uint32_t>(copyRegions.size()), copyRegions.data());
+			stats.copyRegions += copyRegions.size();
+			if (transferFamily != graphicsFamily) {
+				for (const VkBufferCopy& region : copyRegions) {
+					releaseBarriers.push_back(ownershipBarrier(dstBuffer, region.dstOffset, region.size, VK_ACCESS_TRANSFER_WRITE_BIT, 0));
+				}
+			}
+			first = i;
+		}
+		if (!releaseBarriers.empty()) {
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+				0, nullptr, static_cast<uint32_t>(releaseBarriers.size()), releaseBarriers.data(), 0, nullptr);
+			for (VkBufferMemoryBarrier barrier : releaseBarriers) {
+				barrier.srcAccessMask = 0;
+				barrier.dstAccessMask = UPLOAD_CONSUMER_ACCESS;
+				pendingAcquires.push_back(barrier);
+			}
+			releaseBarriers.clear();
+		}
+		vkEndCommandBuffer(commandBuffer);
+
+		submit(commandBuffer);
+		pendingCopies.clear();
+		pendingRanges.clear();
+	}
+
+	// everything flushed so far is complete once this ticket is
+	UploadTicket lastSubmittedTicket() const {
+		return UploadTicket{ lastSubmitted };
+	}
+
+	bool isComplete(UploadTicket ticket) {
+		return transferTimeline->isComplete(ticket.value);
+	}
+
+	// host-side wait, only meant for shutdown and tooling
+	void wait(UploadTicket ticket) {
+		if (ticket.value > lastSubmitted) {
+			flush();
+		}
+		transferTimeline->wait(ticket.value);
+	}
+
+	// Records the graphics side of every ownership transfer released so far. Must go into a command buffer
+	// outside a render pass whose submit waits for lastSubmittedTicket() at UPLOAD_CONSUMER_STAGES.
+	void recordAcquireBarriers(VkCommandBuffer graphicsCommandBuffer) {
+		if (pendingAcquires.empty()) return;
+		vkCmdPipelineBarrier(graphicsCommandBuffer, UPLOAD_CONSUMER_STAGES, UPLOAD_CONSUMER_STAGES, 0,
+			0, nullptr, static_cast<uint32_t>(pendingAcquires.size()), pendingAcquires.data(), 0, nullptr);
+		pendingAcquires.clear();
+	}
+
+	// for buffers the graphics queue will never touch, so no acquire is left behind for a destroyed buffer
+	void discardAcquires(VkBuffer buffer) {
+		pendingAcquires.erase(std::remove_if(pendingAcquires.begin(), pendingAcquires.end(), [buffer](const VkBufferMemoryBarrier& barrier) {
+			return barrier.buffer == buffer;
+		}), pendingAcquires.end());
+	}
+
+	// Drops everything still queued for a buffer about to be destroyed: copies not flushed yet and acquires not
+	// recorded yet. Batches already submitted are not touched; the caller keeps the buffer alive until a graphics
+	// submit that waited for lastSubmittedTicket() has completed. Tickets for its uploads must not be waited on.
+	void cancel(VkBuffer buffer) {
+		pendingCopies.erase(std::remove_if(pendingCopies.begin(), pendingCopies.end(), [buffer](const PendingCopy& copy) {
+			return copy.dstBuffer == buffer;
+		}), pendingCopies.end());
+		pendingRanges.erase(buffer);
+		discardAcquires(buffer);
+	}
+
+	// submits what the frame queued and hands the staging ring its next region
+	void endFrame() {
+		flush();
+		stagingRing->endRegion();
+	}
+
+	const UploadStats& getStats() const {
+		return stats;
+	}
+
+private:
+	VkDevice device = VK_NULL_HANDLE;
+	VkQueue transferQueue = VK_NULL_HANDLE;
+	VkCommandPool transferCommandPool = VK_NULL_HANDLE;
+	StagingRing* stagingRing = nullptr;
+	TimelineSemaphore* transferTimeline = nullptr;
+	uint64_t lastSubmitted = 0;
+	std::deque<std::pair<uint64_t, VkCommandBuffer>> inFlightCommandBuffers;
+	std::vector<VkCommandBuffer> freeCommandBuffers;
+	UploadStats stats;
+
+	struct PendingCopy {
+		VkBuffer dstBuffer;
+		VkBufferCopy region;
+	};
+	VkBuffer stagingBuffer = VK_NULL_HANDLE;
+	std::vector<PendingCopy> pendingCopies;
+	// queued destination ranges per buffer, offset -> end; regions of one vkCmdCopyBuffer must not overlap
+	std::unordered_map<VkBuffer, std::map<VkDeviceSize, VkDeviceSize>> pendingRanges;
+	std::vector<VkBufferCopy> copyRegions;
+	uint32_t transferFamily = 0;
+	uint32_t graphicsFamily = 0;
+	std::vector<VkBufferMemoryBarrier> releaseBarriers;
+	std::vector<VkBufferMemoryBarrier> pendingAcquires;
+
+	VkBufferMemoryBarrier ownershipBarrier(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, VkAccessFlags srcAccess, VkAccessFlags dstAccess) const {
+		VkBufferMemoryBarrier barrier{};
+		barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+		barrier.srcAccessMask = srcAccess;
+		barrier.dstAccessMask = dstAccess;
+		barrier.srcQueueFamilyIndex = transferFamily;
+		barrier.dstQueueFamilyIndex = graphicsFamily;
+		barrier.buffer = buffer;
+		barrier.offset = offset;
+		barrier.size = size;
+		return barrier;
+	}
+
+	bool overlapsPending(VkBuffer dstBuffer, VkDeviceSize offset, VkDeviceSize size) const {
+		auto buffer = pendingRanges.find(dstBuffer);
+		if (buffer == pendingRanges.end()) return false;
+		const auto& ranges = buffer->second;
+		auto next = ranges.upper_bound(offset);
+		if (next != ranges.end() && next->first < offset + size) return true;
+		return next != ranges.begin() && std::prev(next)->second > offset;
+	}
+
+	void recycleCommandBuffers() {
+		while (!inFlightCommandBuffers.empty() && transferTimeline->isComplete(inFlightCommandBuffers.front().first)) {
+			freeCommandBuffers.push_back(inFlightCommandBuffers.front().second);
+			inFlightCommandBuffers.pop_front();
+		}
+	}
+
+	VkCommandBuffer acquireCommandBuffer() {
+		recycleCommandBuffers();
+		if (!freeCommandBuffers.empty()) {
+			VkCommandBuffer commandBuffer = freeCommandBuffers.back();
+			freeCommandBuffers.pop_back();
+			return commandBuffer;
+		}
+
+		VkCommandBufferAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandPool = transferCommandPool;
+		allocInfo.commandBufferCount = 1;
+
+		VkCommandBuffer commandBuffer;
+		if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate upload command buffer!");
+		}
+		return commandBuffer;
+	}
+
+	void submit(VkCommandBuffer commandBuffer) {
+		uint64_t signalValue = transferTimeline->nextValue();
+		VkSemaphore signalSemaphore = transferTimeline->handle();
+
+		VkTimelineSemaphoreSubmitInfo timelineInfo{};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineInfo.signalSemaphoreValueCount = 1;
+		timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+		VkSubmitInfo submitInfo{};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.pNext = &timelineInfo;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &signalSemaphore;
+
+		if (vkQueueSubmit(transferQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
+			throw std::runtime_error("failed to submit upload!");
+		}
+
+		inFlightCommandBuffers.emplace_back(signalValue, commandBuffer);
+		stagingRing->retire(signalValue);
+		lastSubmitted = signalValue;
+		stats.submits++;
+	}
+};
+
+// Creates a buffer for static data and fills it. With directWrite the buffer is host visible and filled
+// through its mapping, which on unified memory is device local anyway: no staging copy, no transfer submit,
+// and the returned ticket is already complete. Otherwise it is GPU-only memory filled through the uploader.
+UploadTicket createGeometryBuffer(VkDeviceSize size, VkBufferUsageFlags usage, const void* data, bool directWrite, VkBuffer& buffer, MemoryAllocation& bufferAllocation, VkDevice device, DeviceMemoryAllocator& allocator, TransferUploader& uploader) {
+	if (directWrite) {
+		createBuffer(size, usage, MemoryUsage::Streaming, buffer, bufferAllocation, device, allocator);
+		memcpy(bufferAllocation.mapped, data, (size_t)size);
+		return UploadTicket{};
+	}
+
+	createBuffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryUsage::GpuOnly, buffer, bufferAllocation, device, allocator);
+	return uploader.upload(buffer, 0, data, size);
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <vector>
+#include <cstring>
+#include <stdexcept>
+
+#include <vulkan/vulkan_core.h>
+#include "CustomQueueUtils.h"
+#include "MemoryAllocator.h"
+#include "BufferUtils.h"
+
+struct UniformAllocation {
+	uint32_t dynamicOffset = 0;
+	void* mapped = nullptr;
+};
+
+// One persistently mapped uniform buffer split into a slice per frame in flight. Each frame bump-allocates
+// its constants from its own slice, aligned to minUniformBufferOffsetAlignment, and hands the offsets to a
+// single UNIFORM_BUFFER_DYNAMIC descriptor. A slice is only rewound once its frame's fence has signalled.
+class UniformRing {
+public:
+	void init(VkDevice device, VkPhysicalDevice physicalDevice, DeviceMemoryAllocator& allocator, VkDeviceSize bytesPerFrame, uint32_t frameCount) {
+		this->device = device;
+
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		alignment = properties.limits.minUniformBufferOffsetAlignment;
+		frameSize = alignUp(bytesPerFrame, alignment);
+		if (frameSize * frameCount > UINT32_MAX) {
+			throw std::runtime_error("uniform ring does not fit 32-bit dynamic offsets");
+		}
+
+		createBuffer(frameSize * frameCount, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, MemoryUsage::Streaming, buffer, bufferAllocation, device, allocator);
+		this->frameCount = frameCount;
+	}
+
+	void destroy(DeviceMemoryAllocator& allocator) {
+		destroyBuffer(buffer, bufferAllocation, device, allocator);
+	}
+
+	// hands the buffer over to the caller, who frees it once the frames using it are done; init starts a new one
+	void release(VkBuffer& buffer, MemoryAllocation& allocation) {
+		buffer = this->buffer;
+		allocation = bufferAllocation;
+		this->buffer = VK_NULL_HANDLE;
+		bufferAllocation = MemoryAllocation{};
+	}
+
+	VkBuffer getBuffer() const {
+		return buffer;
+	}
+
+	// rewinds the frame's slice; everything allocated from it the last time round must be done on the GPU
+	void beginFrame(uint32_t frameIndex) {
+		if (frameIndex >= frameCount) {
+			throw std::runtime_error("uniform ring has no slice for this frame index");
+		}
+		frameBase = frameIndex * frameSize;
+		head = 0;
+	}
+
+	UniformAllocation allocate(VkDeviceSize size) {
+		VkDeviceSize offset = alignUp(head, alignment);
+		if (offset + size > frameSize) {
+			throw std::runtime_error("uniform ring frame slice exhausted");
+		}
+		head = offset + size;
+
+		UniformAllocation allocation{};
+		allocation.dynamicOffset = static_cast<uint32_t>(frameBase + offset);
+		allocation.mapped = static_cast<char*>(bufferAllocation.mapped) + frameBase + offset;
+		return allocation;
+	}
+
+	// count elements, each aligned, in one go so they can be filled in from several threads
+	UniformAllocation allocateArray(VkDeviceSize elementSize, uint32_t count, VkDeviceSize& stride) {
+		stride = alignUp(elementSize, alignment);
+		return allocate(stride * count);
+	}
+
+	template<typename T>
+	uint32_t push(const T& value) {
+		UniformAllocation allocation = allocate(sizeof(T));
+		memcpy(allocation.mapped, &value, sizeof(T));
+		return allocation.dynamicOffset;
+	}
+
+	VkDeviceSize bytesUsed() const {
+		return head;
+	}
+
+	VkDeviceSize getFrameCapacity() const {
+		return frameSize;
+	}
+
+private:
+	VkDevice device = VK_NULL_HANDLE;
+	VkBuffer buffer = VK_NULL_HANDLE;
+	MemoryAllocation bufferAllocation;
+	VkDeviceSize alignment = 1;
+	VkDeviceSize frameSize = 0;
+	uint32_t frameCount = 0;
+	VkDeviceSize frameBase = 0;
+	VkDeviceSize head = 0;
+};
@@ -5,16 +5,22 @@
 #include <set>
 #include <array>
 #include <chrono>
+#include <thread>
+#include <atomic>
 
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#ifdef _WIN32
 #define VK_USE_PLATFORM_WIN32_KHR
+#endif
 #define GLFW_INCLUDE_VULKAN
 #include "GLFW/glfw3.h"
+#ifdef _WIN32
 #define GLFW_EXPOSE_NATIVE_WIN32
 #include "GLFW/glfw3native.h"
+#endif
 
 #include <vulkan/vulkan_raii.hpp>
 #include <vulkan/vk_platform.h>
@@ -26,6 +32,32 @@
 #include "CustomSwapChainUtils.h"
 #include "ShaderUtils.h"
 #include "BufferUtils.h"
+#include "MemoryAllocator.h"
+#include "StagingRing.h"
+#include "TimelineSemaphore.h"
+#include "TransferUploader.h"
+#include "UniformRing.h"
+#include "DeletionQueue.h"
+#include "HostAllocator.h"
+#include "FramePacing.h"
+#include "OffscreenTarget.h"
+#include "FrameBenchmark.h"
+#include "CommandCache.h"
+#include "JobSystem.h"
+#include "Culling.h"
+#include "ParallelRecorder.h"
+#include "PipelineCache.h"
+#include "PipelineCompiler.h"
+#include "PipelineRegistry.h"
+#include "Benchmarks.h"
+
+std::string dynamicStateName(const PipelineFeatures& features) {
+	std::string name = "viewport, scissor";
+	if (features.extendedDynamicState) name += ", cull mode, front face, topology";
+	if (features.extendedDynamicState2) name += ", primitive restart";
+	if (features.dynamicBlend) name += ", blend enable, write mask";
+	return name;
+}
 
 const std::vector<char const*> validationLayers = {
 	"VK_LAYER_KHRONOS_validation"
@@ -43,7 +75,176 @@ constexpr bool enableValidationLayers = true;
 
 constexpr uint32_t WIDTH = 800;
 constexpr uint32_t HEIGHT = 600;
-const int MAX_FRAMES_IN_FLIGHT = 2;
+constexpr uint32_t HEADLESS_FRAME_COUNT = 1000;
+constexpr uint32_t BENCHMARK_WARMUP_FRAMES = 100;
+constexpr uint32_t BENCHMARK_FRAME_COUNT = 1000;
+constexpr uint32_t STAGING_REGION_COUNT = 3;
+constexpr VkDeviceSize STAGING_REGION_SIZE = 8 * 1024 * 1024;
+constexpr VkDeviceSize UNIFORM_FRAME_SIZE = 8 * 1024 * 1024;
+// the live set plus those of outgrown uniform rings, freed once the frames using them retire
+constexpr uint32_t UNIFORM_DESCRIPTOR_SETS = 8;
+// objects per job when writing constants or culling
+constexpr uint32_t OBJECTS_PER_JOB = 1024;
+constexpr auto PIPELINE_CACHE_SAVE_INTERVAL = std::chrono::seconds(60);
+
+// what draws do while their pipeline is still compiling
+enum class PendingPipelinePolicy { Fallback, Skip, Wait };
+
+struct AppOptions {
+	bool allocatorBenchmark = false;
+	bool stagingBenchmark = false;
+	bool uploadStallCheck = false;
+	bool geometryBenchmark = false;
+	bool jobScalingBenchmark = false;
+	uint32_t pipelineBenchmarkCount = 0;	// 0: no pipeline compile benchmark
+	bool commandPoolBenchmark = false;
+	bool hostAllocator = false;
+	std::string frameProfile = "balanced";
+	uint32_t framesInFlight = 0;	// 0: from the profile
+	uint32_t swapchainImages = 0;	// 0: from the profile
+	bool resizeWaitIdle = false;
+	// no window: present to VK_EXT_headless_surface when the instance has it, otherwise render offscreen
+	bool headless = false;
+	bool offscreen = false;
+	uint32_t frameCount = 0;	// 0: until the window is closed
+	std::string scene = "quad";
+	// static draws replayed from cached secondaries; off re-records everything every frame
+	bool commandCache = true;
+	// job system workers, the main thread included
+	uint32_t workerThreads = std::max(std::thread::hardware_concurrency(), 1u);
+	// reset every frame command buffer on its own instead of each frame's pools as a whole
+	bool perBufferReset = false;
+	// fixed animation step, --frames measured frames after --warmup frames, timings written to --bench-output
+	bool frameBenchmark = false;
+	uint32_t warmupFrames = BENCHMARK_WARMUP_FRAMES;
+	std::string benchmarkOutput = "frame_benchmark.json";
+	// empty: no pipeline cache; reset starts from an empty cache and overwrites the file, for cold start timings
+	std::string pipelineCachePath = "pipeline_cache.bin";
+	bool pipelineCacheReset = false;
+	// fallback draws with the generic pipeline, skip leaves the draws out, wait blocks the frame until it is compiled
+	PendingPipelinePolicy pendingPipelines = PendingPipelinePolicy::Fallback;
+	// off compiles every pipeline in one piece with all of its state baked in, as on devices without the extensions
+	bool dynamicState = true;
+	bool pipelineLibraries = true;
+};
+
+PendingPipelinePolicy parsePendingPipelinePolicy(const std::string& name) {
+	if (name == "fallback") return PendingPipelinePolicy::Fallback;
+	if (name == "skip") return PendingPipelinePolicy::Skip;
+	if (name == "wait") return PendingPipelinePolicy::Wait;
+	throw std::runtime_error("unknown pending pipeline policy: " + name);
+}
+
+const char* pendingPipelinePolicyName(PendingPipelinePolicy policy) {
+	switch (policy) {
+	case PendingPipelinePolicy::Fallback: return "fallback";
+	case PendingPipelinePolicy::Skip: return "skip";
+	case PendingPipelinePolicy::Wait: return "wait";
+	}
+	return "unknown";
+}
+
+AppOptions parseAppOptions(int argc, char* argv[]) {
+	AppOptions options;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--bench-alloc") {
+			options.allocatorBenchmark = true;
+		}
+		else if (arg == "--bench-staging") {
+			options.stagingBenchmark = true;
+		}
+		else if (arg == "--check-uploads") {
+			options.uploadStallCheck = true;
+		}
+		else if (arg == "--bench-geometry") {
+			options.geometryBenchmark = true;
+		}
+		else if (arg == "--bench-command-pools") {
+			options.commandPoolBenchmark = true;
+		}
+		else if (arg == "--bench-pipelines" && i + 1 < argc) {
+			options.pipelineBenchmarkCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--bench-jobs") {
+			options.jobScalingBenchmark = true;
+		}
+		else if (arg == "--host-allocator") {
+			options.hostAllocator = true;
+		}
+		else if (arg == "--profile" && i + 1 < argc) {
+			options.frameProfile = argv[++i];
+		}
+		else if (arg == "--frames-in-flight" && i + 1 < argc) {
+			options.framesInFlight = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--swapchain-images" && i + 1 < argc) {
+			options.swapchainImages = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--resize-wait-idle") {
+			options.resizeWaitIdle = true;
+		}
+		else if (arg == "--headless") {
+			options.headless = true;
+		}
+		else if (arg == "--offscreen") {
+			options.headless = true;
+			options.offscreen = true;
+		}
+		else if (arg == "--frames" && i + 1 < argc) {
+			options.frameCount = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--scene" && i + 1 < argc) {
+			options.scene = argv[++i];
+		}
+		else if (arg == "--no-command-cache") {
+			options.commandCache = false;
+		}
+		else if (arg == "--threads" && i + 1 < argc) {
+			options.workerThreads = std::max(static_cast<uint32_t>(std::stoul(argv[++i])), 1u);
+		}
+		else if (arg == "--per-buffer-reset") {
+			options.perBufferReset = true;
+		}
+		else if (arg == "--bench-frames") {
+			options.frameBenchmark = true;
+		}
+		else if (arg == "--warmup" && i + 1 < argc) {
+			options.warmupFrames = static_cast<uint32_t>(std::stoul(argv[++i]));
+		}
+		else if (arg == "--bench-output" && i + 1 < argc) {
+			options.benchmarkOutput = argv[++i];
+		}
+		else if (arg == "--pipeline-cache" && i + 1 < argc) {
+			options.pipelineCachePath = argv[++i];
+		}
+		else if (arg == "--no-pipeline-cache") {
+			options.pipelineCachePath.clear();
+		}
+		else if (arg == "--pipeline-cache-reset") {
+			options.pipelineCacheReset = true;
+		}
+		else if (arg == "--no-dynamic-state") {
+			options.dynamicState = false;
+		}
+		else if (arg == "--no-pipeline-library") {
+			options.pipelineLibraries = false;
+		}
+		else if (arg == "--pending-pipelines" && i + 1 < argc) {
+			options.pendingPipelines = parsePendingPipelinePolicy(argv[++i]);
+		}
+		else {
+			throw std::runtime_error("unknown option: " + arg);
+		}
+	}
+	if (options.frameBenchmark && options.frameCount == 0) {
+		options.frameCount = BENCHMARK_FRAME_COUNT;
+	}
+	if (options.headless && options.frameCount == 0) {
+		options.frameCount = HEADLESS_FRAME_COUNT;
+	}
+	return options;
+}
 
 struct UniformBufferObject {
 	glm::mat4 model;
@@ -89,6 +290,43 @@ const std::vector<uint16_t> indices = {
 	0, 1, 2, 2, 3, 0
 };
 
+// What the frame loop draws: the quad repeated on a grid, with its own uniforms and draw call per copy.
+// Static quads are drawn every frame; of the dynamic ones a different number is drawn each frame, the way
+// culled content would be, so their commands have to be recorded per frame.
+struct SceneDescription {
+	std::string name;
+	uint32_t staticQuads;
+	uint32_t dynamicQuads;
+};
+
+const std::vector<SceneDescription> SCENES = {
+	{ "quad", 1, 0 },
+	{ "grid", 256, 0 },
+	{ "dense", 4096, 0 },
+	{ "mixed", 4096, 256 },
+	{ "huge", 100000, 0 },
+};
+
+// Materials only differ in pipeline state so far; the ones asking for the same state share a pipeline.
+// Each grid row of a scene uses the next material.
+struct MaterialDescription {
+	std::string name;
+	bool blend;
+};
+
+const std::vector<MaterialDescription> MATERIALS = {
+	{ "plain", false },
+	{ "painted", false },
+	{ "glass", true },
+};
+
+SceneDescription findScene(const std::string& name) {
+	for (const auto& scene : SCENES) {
+		if (scene.name == name) return scene;
+	}
+	throw std::runtime_error("unknown scene: " + name);
+}
+
 VkResult CreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugUtilsMessengerEXT* pDebugMessenger) {
 	auto func = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
 	if (func != nullptr) {
@@ -108,20 +346,70 @@ void DestroyDebugUtilMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT
 
 class HelloTriangleApplication {
 public:
+	explicit HelloTriangleApplication(const AppOptions& options)
+		: options(options), allocationCallbacks(options.hostAllocator ? hostAllocator.getCallbacks() : nullptr) {
+		frameProfile = findFrameProfile(options.frameProfile);
+		if (options.framesInFlight > 0) {
+			frameProfile.framesInFlight = options.framesInFlight;
+		}
+		scene = findScene(options.scene);
+		if (options.frameBenchmark) {
+			frameBenchmark.init(options.warmupFrames, options.frameCount);
+		}
+	}
 
 	void run() {
 		initWindow();
 		initVulkan();
-		mainLoop();
+		if (options.allocatorBenchmark) {
+			Benchmarks::runBufferAllocationBenchmark(device, physicalDevice, queueFamilyIndices, memoryAllocator);
+		}
+		else if (options.stagingBenchmark) {
+			Benchmarks::runStagingBenchmark(device, memoryAllocator, stagingRing, uploader, transferCommandPool, transferQueue);
+		}
+		else if (options.uploadStallCheck) {
+			exitCode = Benchmarks::runUploadStallCheck(device, memoryAllocator, stagingRing, uploader) ? EXIT_SUCCESS : EXIT_FAILURE;
+		}
+		else if (options.geometryBenchmark) {
+			Benchmarks::runGeometryUploadBenchmark(device, memoryAllocator, uploader);
+		}
+		else if (options.pipelineBenchmarkCount > 0) {
+			Benchmarks::runPipelineCompileBenchmark(device, scenePipelineDescription(), options.pipelineBenchmarkCount,
+				std::max(std::thread::hardware_concurrency(), 1u), pipelineFeatures, allocationCallbacks);
+		}
+		else if (options.jobScalingBenchmark) {
+			Benchmarks::runJobScalingBenchmark(std::max(std::thread::hardware_concurrency(), 1u));
+		}
+		else if (options.commandPoolBenchmark) {
+			Benchmarks::runCommandPoolBenchmark(device, queueFamilyIndices, allocationCallbacks);
+		}
+		else {
+			mainLoop();
+			if (options.frameBenchmark) {
+				writeFrameBenchmark();
+			}
+		}
 		cleanUp();
 	}
 
+	int getExitCode() const {
+		return exitCode;
+	}
+
 private:
+	AppOptions options;
+	int exitCode = EXIT_SUCCESS;
+	// driver host allocations for everything created here; nullptr keeps the driver's own allocator
+	HostAllocator hostAllocator;
+	const VkAllocationCallbacks* allocationCallbacks;
 	GLFWwindow* m_window = nullptr;
 	VkInstance instance;
 	VkDebugUtilsMessengerEXT debugMessenger = nullptr;
-	VkSurfaceKHR surface;
-	VkSwapchainKHR swapChain;
+	// VK_NULL_HANDLE when rendering offscreen, then offscreenTarget provides the images
+	VkSurfaceKHR surface = VK_NULL_HANDLE;
+	bool headlessSurfaceSupported = false;
+	OffscreenTarget offscreenTarget;
+	VkSwapchainKHR swapChain = VK_NULL_HANDLE;
 	std::vector<VkImage> swapChainImages;
 	VkFormat swapChainImageFormat;
 	VkExtent2D swapChainExtent;
@@ -132,35 +420,87 @@ private:
 	VkQueue presentQueue;
 	VkQueue transferQueue;
 	QueueFamilyIndices queueFamilyIndices;
+	DeviceMemoryAllocator memoryAllocator;
 
 	std::vector<VkImageView> swapChainImageViews;
 	VkRenderPass renderPass;
 	VkDescriptorSetLayout descriptorSetLayout;
 	VkPipelineLayout pipelineLayout;
-	VkPipeline graphicsPipeline;
+	std::vector<PipelineId> materialPipelines;
+	// kept for the state the pipelines leave dynamic
+	std::vector<PipelineDescription> materialDescriptions;
+	PipelineDescription fallbackDescription;
+	// generic opaque pipeline, compiled before the first frame, standing in for pipelines still compiling
+	PipelineId fallbackPipeline = 0;
+	// draws recorded with the fallback, or left out, because their pipeline was not ready yet
+	std::atomic<uint64_t> pendingPipelineDraws{ 0 };
 
 	std::vector<VkFramebuffer> swapChainFrameBuffers;
 
-	VkCommandPool commandPool;
 	VkCommandPool transferCommandPool;
-	std::vector<VkCommandBuffer> commandBuffers;
+	TimelineSemaphore transferTimeline;
+	StagingRing stagingRing;
+	TransferUploader uploader;
 
 	VkBuffer vertexBuffer;
-	VkDeviceMemory vertexBufferMemory;
+	MemoryAllocation vertexBufferAllocation;
 	VkBuffer indexBuffer;
-	VkDeviceMemory indexBufferMemory;
-
-	std::vector<VkBuffer> uniformBuffers;
-	std::vector<VkDeviceMemory> uniformBuffersMemory;
-	std::vector<void*> uniformBuffersMapped;
+	MemoryAllocation indexBufferAllocation;
+
+	UniformRing uniformRing;
+	VkDescriptorPool descriptorPool;
+	VkDescriptorSet descriptorSet;
+	// S cycles through SCENES; every change bumps sceneVersion, which invalidates recorded static commands
+	SceneDescription scene;
+	uint64_t sceneVersion = 0;
+	int pendingScene = -1;
+	uint32_t dynamicQuadCount = 0;
+	uint32_t gridSide = 1;
+	std::vector<uint32_t> objectUniformOffsets;
+	char* objectUniforms = nullptr;
+	VkDeviceSize objectUniformStride = 0;
+	glm::mat4 cameraView{ 1.0f };
+	glm::mat4 cameraProj{ 1.0f };
+	std::vector<uint8_t> objectVisible;
+	std::vector<uint32_t> visibleStaticObjects;
+	std::vector<uint32_t> visibleDynamicObjects;
+	SceneCommandCache commandCache;
+	StaticCommandKey staticCommandKey;
+	bool staticCommandsCached = false;
+	std::vector<VkCommandBuffer> cachedStaticCommands;
+	JobSystem jobs;
+	ParallelRecorder recorder;
 
 	std::vector<VkSemaphore> imageAvailableSemaphores;
 	std::vector<VkSemaphore> renderFinishedSemaphores;
-	std::vector<VkFence> inFlightFences;
+	// frame N signals N once the GPU is done with it; replaces the per-frame fences
+	TimelineSemaphore frameTimeline;
+	DeletionQueue deletionQueue;
+
+	// frames in flight and swapchain size; keys 1-3 switch between FRAME_PROFILES at runtime
+	FrameProfile frameProfile;
+	int pendingProfile = -1;
+	uint32_t frameSlot = 0;
+	LatencyTracker latency;
+	bool presentWaitEnabled = false;
+	PresentPacer presentPacer;
+	FrameTimeTracker frameTimes;
+
+	GpuTimer gpuTimer;
+	FrameBenchmark frameBenchmark;
+	std::chrono::steady_clock::time_point lastFrameStart;
+
+	PipelineCacheFile pipelineCache;
+	PipelineFeatures pipelineFeatures;
+	PipelineCompiler pipelineCompiler;
+	PipelineRegistry pipelineRegistry;
+	double pipelineCreateMs = 0.0;
+	double startupMs = 0.0;
 
 	bool framebufferResized = false;
 
 	void initWindow() {
+		if (options.headless) return;
 		glfwInit();
 		
 		glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
@@ -170,14 +510,20 @@ private:
 		glfwSetWindowAttrib(m_window, GLFW_RESIZABLE, GLFW_TRUE);
 		glfwSetWindowUserPointer(m_window, this);
 		glfwSetFramebufferSizeCallback(m_window, framebufferResizeCallback);
+		glfwSetKeyCallback(m_window, keyCallback);
+		glfwSetCursorPosCallback(m_window, cursorPosCallback);
 	}
 
 	void initVulkan() {
+		auto startupStart = std::chrono::steady_clock::now();
+		// pipeline compiles run beside the workers, on threads of their own
+		jobs.init(options.workerThreads, std::max(options.workerThreads / 2, 1u));
 		createInstance();
 		setupDebugMessenger();
 		createSurface();
 		pickPhysicalDevice();
 		createLogicalDevice();
+		createPipelineCache();
 		createSwapChain();
 		createImageViews();
 		createRenderPass();
@@ -185,53 +531,97 @@ private:
 		createGraphicsPipeline();
 		createFramebuffers();
 		createCommandPool();
+		createUploader();
 		createVertexBuffer();
 		createIndexBuffer();
 		createUniformBuffer();
+		createDescriptorPool();
+		createDescriptorSet();
 		createCommandBuffers();
 		createSyncObjects();
+		createGpuTimer();
+		startupMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startupStart).count();
+		std::cout << "pipeline cache " << PipelineCacheFile::describe(pipelineCache.getLoadResult()) << ", " << pipelineCache.getLoadedBytes()
+			<< " bytes loaded; pipeline creation " << pipelineCreateMs << " ms, startup " << startupMs << " ms" << std::endl;
 	}
 
 	void mainLoop() {
-		while (!glfwWindowShouldClose(m_window)) {
-			glfwPollEvents();
+		lastFrameStart = std::chrono::steady_clock::now();
+		while (!shouldClose()) {
+			if (m_window) {
+				glfwPollEvents();
+			}
 			drawFrame();
+			pipelineCache.saveIfDue(PIPELINE_CACHE_SAVE_INTERVAL);
 		}
 
 		vkDeviceWaitIdle(device);
 	}
 
 	void cleanUp() {
+		vkDeviceWaitIdle(device);
+		deletionQueue.flush();
 		cleanupSwapChain();
-		vkDestroyBuffer(device, vertexBuffer, nullptr);
-		vkFreeMemory(device, vertexBufferMemory, nullptr);
-		vkDestroyBuffer(device, indexBuffer, nullptr);
-		vkFreeMemory(device, indexBufferMemory, nullptr);
-		for (size_t i = 0;i < MAX_FRAMES_IN_FLIGHT;i++) {
-			vkDestroyFence(device, inFlightFences[i], nullptr);
-			vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
-			vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
-		}
-		vkDestroyCommandPool(device, commandPool, nullptr);
+		destroyBuffer(vertexBuffer, vertexBufferAllocation, device, memoryAllocator);
+		destroyBuffer(indexBuffer, indexBufferAllocation, device, memoryAllocator);
+		latency.report(std::cout, frameProfile.name);
+		presentPacer.report(std::cout);
+		frameTimes.report(std::cout, options.resizeWaitIdle ? "device wait idle" : "retiring through frame tracking");
+		if (options.commandCache) {
+			CommandCacheStats cacheStats = commandCache.getStats();
+			std::cout << "static commands: " << cacheStats.hits << " replayed, " << cacheStats.misses << " recorded" << std::endl;
+		}
+		PipelineRegistryStats pipelineStats = pipelineRegistry.getStats();
+		std::cout << "pending pipelines (" << pendingPipelinePolicyName(options.pendingPipelines) << "): " << pipelineStats.hitchesAvoided << " hitches avoided, "
+			<< pipelineStats.fallbackFrames << " frames with a pipeline still compiling, " << pendingPipelineDraws.load() << " draws recorded without their own pipeline" << std::endl;
+		gpuTimer.destroy();
+		recorder.destroy();
+		jobs.destroy();
+		frameTimeline.destroy();
+		destroyFrameSemaphores();
 	
-		for (size_t i = 0;i < MAX_FRAMES_IN_FLIGHT;i++) {
-			vkDestroyBuffer(device, uniformBuffers[i], nullptr);
-			vkFreeMemory(device, uniformBuffersMemory[i], nullptr);
+		uniformRing.destroy(memoryAllocator);
+		vkDestroyDescriptorPool(device, descriptorPool, allocationCallbacks);
+		vkDestroyDescriptorSetLayout(device, descriptorSetLayout, allocationCallbacks);
+		pipelineRegistry.destroy();
+		vkDestroyPipelineLayout(device, pipelineLayout, allocationCallbacks);
+		vkDestroyRenderPass(device, renderPass, allocationCallbacks);
+
+		uploader.destroy();
+		vkDestroyCommandPool(device, transferCommandPool, allocationCallbacks);
+		stagingRing.destroy(memoryAllocator);
+		transferTimeline.destroy();
+		memoryAllocator.destroy();
+		pipelineCompiler.destroy();
+		pipelineCache.save();
+		pipelineCache.destroy();
+		vkDestroyDevice(device, allocationCallbacks);
+		if (presentsToSurface()) {
+			vkDestroySurfaceKHR(instance, surface, allocationCallbacks);
 		}
-		vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
-		vkDestroyPipeline(device, graphicsPipeline, nullptr);
-		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
-		vkDestroyRenderPass(device, renderPass, nullptr);
-
-		vkDestroyDevice(device, nullptr);
-		vkDestroySurfaceKHR(instance, surface, nullptr);
 		if (enableValidationLayers) {
-			DestroyDebugUtilMessengerEXT(instance, debugMessenger, nullptr);
+			DestroyDebugUtilMessengerEXT(instance, debugMessenger, allocationCallbacks);
 		}
-		vkDestroyInstance(instance, nullptr);
+		vkDestroyInstance(instance, allocationCallbacks);
+		if (options.hostAllocator) {
+			hostAllocator.printStats(std::cout);
+		}
+
+		if (m_window) {
+			glfwDestroyWindow(m_window);
+			glfwTerminate();
+		}
+	}
+
+	bool shouldClose() {
+		// a benchmark runs its warm-up first, and a few frames past the end so the last GPU times get read back
+		uint64_t lastFrame = options.frameBenchmark ? frameBenchmark.lastFrame() + frameProfile.framesInFlight : options.frameCount;
+		if (lastFrame > 0 && currentFrameNumber() > lastFrame) return true;
+		return m_window && glfwWindowShouldClose(m_window);
+	}
 
-		glfwDestroyWindow(m_window);
-		glfwTerminate();
+	bool presentsToSurface() const {
+		return surface != VK_NULL_HANDLE;
 	}
 
 
@@ -242,7 +632,7 @@ private:
 		appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
 		appInfo.pEngineName = "No Engine";
 		appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-		appInfo.apiVersion = VK_API_VERSION_1_0;
+		appInfo.apiVersion = VK_API_VERSION_1_2;
 
 		std::vector<char const*> requiredLayers;
 		if (enableValidationLayers) {
@@ -276,7 +666,7 @@ private:
 		}
 
 		uint32_t glfwExtensionCount = 0;
-		auto glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+		auto glfwExtensions = options.headless ? nullptr : glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 		for (uint32_t i = 0;i < glfwExtensionCount;i++) {
 			if (extensionProperties.end() ==
 				std::find_if(extensionProperties.begin(), extensionProperties.end(), [glfwExtension = glfwExtensions[i]](vk::ExtensionProperties extensionProperty) {
@@ -287,6 +677,12 @@ private:
 			}
 		}
 
+		if (options.headless && !options.offscreen) {
+			headlessSurfaceSupported = std::any_of(extensionProperties.begin(), extensionProperties.end(), [](const VkExtensionProperties& extensionProperty) {
+				return strcmp(extensionProperty.extensionName, VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME) == 0;
+			});
+		}
+
 		auto extensions = getRequiredExtensions();
 
 		VkInstanceCreateInfo createInfo{};
@@ -310,17 +706,25 @@ private:
 		}
 		createInfo.pNext = nullptr;
 
-		if (vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS) {
+		if (vkCreateInstance(&createInfo, allocationCallbacks, &instance) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create instance");
 		}
 	}
 
 
 	std::vector<const char*> getRequiredExtensions() {
-		uint32_t glfwExtensionCount = 0;
-		auto glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-
-		std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+		std::vector<const char*> extensions;
+		if (options.headless) {
+			if (headlessSurfaceSupported) {
+				extensions.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
+				extensions.push_back(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
+			}
+		}
+		else {
+			uint32_t glfwExtensionCount = 0;
+			auto glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+			extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+		}
 		if (enableValidationLayers) {
 			extensions.push_back(vk::EXTDebugUtilsExtensionName);
 		}
@@ -343,7 +747,7 @@ private:
 		VkDebugUtilsMessengerCreateInfoEXT debugMessagerCreateInfo{};
 		prepareDebugMeesengerCreateInfo(debugMessagerCreateInfo);
 
-		if (CreateDebugUtilsMessengerEXT(instance, &debugMessagerCreateInfo, nullptr, &debugMessenger) != VK_SUCCESS) {
+		if (CreateDebugUtilsMessengerEXT(instance, &debugMessagerCreateInfo, allocationCallbacks, &debugMessenger) != VK_SUCCESS) {
 			throw std::runtime_error("failed to setup debug messenger!");
 		}
 	}
@@ -354,15 +758,38 @@ private:
 	}
 
 	void createSurface() {
+		if (options.headless) {
+			createHeadlessSurface();
+			std::cout << "headless: " << (presentsToSurface() ? "VK_EXT_headless_surface swapchain" : "offscreen images") << ", " << options.frameCount << " frames" << std::endl;
+			return;
+		}
+#ifdef _WIN32
 		VkWin32SurfaceCreateInfoKHR createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR;
 		createInfo.hwnd = glfwGetWin32Window(m_window);
 		createInfo.hinstance = GetModuleHandle(nullptr);
 
 		auto CreateWin32SurfaceKHR = (PFN_vkCreateWin32SurfaceKHR)vkGetInstanceProcAddr(instance, "vkCreateWin32SurfaceKHR");
-		if (!CreateWin32SurfaceKHR || CreateWin32SurfaceKHR(instance, &createInfo, nullptr, &surface) != VK_SUCCESS) {
+		if (!CreateWin32SurfaceKHR || CreateWin32SurfaceKHR(instance, &createInfo, allocationCallbacks, &surface) != VK_SUCCESS) {
 			throw std::runtime_error("failed to created window surface!");
 		}
+#else
+		if (glfwCreateWindowSurface(instance, m_window, allocationCallbacks, &surface) != VK_SUCCESS) {
+			throw std::runtime_error("failed to created window surface!");
+		}
+#endif
+	}
+
+	// leaves surface null, and rendering offscreen, when the extension is missing or --offscreen asked for it
+	void createHeadlessSurface() {
+		if (!headlessSurfaceSupported) return;
+
+		VkHeadlessSurfaceCreateInfoEXT createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT;
+		auto CreateHeadlessSurfaceEXT = (PFN_vkCreateHeadlessSurfaceEXT)vkGetInstanceProcAddr(instance, "vkCreateHeadlessSurfaceEXT");
+		if (!CreateHeadlessSurfaceEXT || CreateHeadlessSurfaceEXT(instance, &createInfo, allocationCallbacks, &surface) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create headless surface!");
+		}
 	}
 
 	void pickPhysicalDevice() {
@@ -399,9 +826,26 @@ private:
 		return requiredExtensionsSet.empty();
 	}
 
+	bool isDeviceExtensionSupported(VkPhysicalDevice device, const char* extensionName) {
+		uint32_t extensionCount;
+		vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+		std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+		vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+		for (const auto& availableExtension : availableExtensions) {
+			if (strcmp(availableExtension.extensionName, extensionName) == 0) return true;
+		}
+		return false;
+	}
+
 	bool isDeviceSuitable(VkPhysicalDevice device, VkSurfaceKHR surface) {
 		QueueFamilyIndices indices = findQueueFamliies(device, surface);
 
+		// offscreen rendering needs neither the swapchain extension nor a surface format
+		if (surface == VK_NULL_HANDLE) {
+			return indices.isComplete() && isTimelineSemaphoreSupported(device);
+		}
+
 		bool extensionSupported = checkDeviceExtensionSupport(device);
 
 		bool swapChainOk = false;
@@ -410,7 +854,77 @@ private:
 			swapChainOk = !swapChainDetails.formats.empty() && !swapChainDetails.presentModes.empty();
 		}
 
-		return indices.isComplete() && extensionSupported && swapChainOk;
+		return indices.isComplete() && extensionSupported && swapChainOk && isTimelineSemaphoreSupported(device);
+	}
+
+	// Which of the optional pipeline extensions the device has, together with their feature bits. Feature structs
+	// only go into the query for extensions that are there.
+	PipelineFeatures queryPipelineFeatures() {
+		VkPhysicalDeviceExtendedDynamicStateFeaturesEXT dynamicStateFeatures{};
+		dynamicStateFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
+		VkPhysicalDeviceExtendedDynamicState2FeaturesEXT dynamicState2Features{};
+		dynamicState2Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_2_FEATURES_EXT;
+		VkPhysicalDeviceExtendedDynamicState3FeaturesEXT dynamicState3Features{};
+		dynamicState3Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+		VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT libraryFeatures{};
+		libraryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+
+		VkPhysicalDeviceFeatures2 features2{};
+		features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+		if (options.dynamicState && isDeviceExtensionSupported(physicalDevice, VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME)) {
+			dynamicStateFeatures.pNext = features2.pNext;
+			features2.pNext = &dynamicStateFeatures;
+		}
+		if (options.dynamicState && isDeviceExtensionSupported(physicalDevice, VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME)) {
+			dynamicState2Features.pNext = features2.pNext;
+			features2.pNext = &dynamicState2Features;
+		}
+		if (options.dynamicState && isDeviceExtensionSupported(physicalDevice, VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME)) {
+			dynamicState3Features.pNext = features2.pNext;
+			features2.pNext = &dynamicState3Features;
+		}
+		if (options.pipelineLibraries && isDeviceExtensionSupported(physicalDevice, VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME)
+			&& isDeviceExtensionSupported(physicalDevice, VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME)) {
+			libraryFeatures.pNext = features2.pNext;
+			features2.pNext = &libraryFeatures;
+		}
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+
+		PipelineFeatures features;
+		features.extendedDynamicState = dynamicStateFeatures.extendedDynamicState == VK_TRUE;
+		features.extendedDynamicState2 = dynamicState2Features.extendedDynamicState2 == VK_TRUE;
+		features.dynamicBlend = dynamicState3Features.extendedDynamicState3ColorBlendEnable == VK_TRUE
+			&& dynamicState3Features.extendedDynamicState3ColorWriteMask == VK_TRUE;
+		// without fast linking a link is not guaranteed to be cheaper than a full compile, so monolithic it is
+		if (libraryFeatures.graphicsPipelineLibrary == VK_TRUE) {
+			VkPhysicalDeviceGraphicsPipelineLibraryPropertiesEXT libraryProperties{};
+			libraryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_PROPERTIES_EXT;
+			VkPhysicalDeviceProperties2 properties2{};
+			properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+			properties2.pNext = &libraryProperties;
+			vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+			features.graphicsPipelineLibrary = libraryProperties.graphicsPipelineLibraryFastLinking == VK_TRUE;
+			if (!features.graphicsPipelineLibrary) {
+				std::cout << "graphics pipeline libraries without fast linking, compiling monolithic pipelines" << std::endl;
+			}
+		}
+		return features;
+	}
+
+	bool isTimelineSemaphoreSupported(VkPhysicalDevice device) {
+		VkPhysicalDeviceProperties deviceProperties;
+		vkGetPhysicalDeviceProperties(device, &deviceProperties);
+		bool timelineSemaphoreOk = false;
+		if (deviceProperties.apiVersion >= VK_API_VERSION_1_2) {
+			VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures{};
+			timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+			VkPhysicalDeviceFeatures2 features2{};
+			features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+			features2.pNext = &timelineFeatures;
+			vkGetPhysicalDeviceFeatures2(device, &features2);
+			timelineSemaphoreOk = timelineFeatures.timelineSemaphore == VK_TRUE;
+		}
+		return timelineSemaphoreOk;
 	}
 
 	void createLogicalDevice() {
@@ -430,15 +944,96 @@ private:
 		}
 
 		VkPhysicalDeviceFeatures deviceFeatures{};
+		VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures{};
+		timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+		timelineFeatures.timelineSemaphore = VK_TRUE;
+
+		// present id + present wait are only useful together, and both have feature bits on top of the extension
+		presentWaitEnabled = presentsToSurface() && isDeviceExtensionSupported(physicalDevice, VK_KHR_PRESENT_ID_EXTENSION_NAME) && isDeviceExtensionSupported(physicalDevice, VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+		VkPhysicalDevicePresentIdFeaturesKHR presentIdFeatures{};
+		presentIdFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+		VkPhysicalDevicePresentWaitFeaturesKHR presentWaitFeatures{};
+		presentWaitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+		presentIdFeatures.pNext = &presentWaitFeatures;
+		if (presentWaitEnabled) {
+			VkPhysicalDeviceFeatures2 features2{};
+			features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+			features2.pNext = &presentIdFeatures;
+			vkGetPhysicalDeviceFeatures2(physicalDevice, &features2);
+			presentWaitEnabled = presentIdFeatures.presentId == VK_TRUE && presentWaitFeatures.presentWait == VK_TRUE;
+		}
+		if (presentWaitEnabled) {
+			timelineFeatures.pNext = &presentIdFeatures;
+		}
+
+		// only the feature bits the pipelines use are enabled
+		pipelineFeatures = queryPipelineFeatures();
+		VkPhysicalDeviceExtendedDynamicStateFeaturesEXT dynamicStateFeatures{};
+		dynamicStateFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT;
+		dynamicStateFeatures.extendedDynamicState = VK_TRUE;
+		VkPhysicalDeviceExtendedDynamicState2FeaturesEXT dynamicState2Features{};
+		dynamicState2Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_2_FEATURES_EXT;
+		dynamicState2Features.extendedDynamicState2 = VK_TRUE;
+		VkPhysicalDeviceExtendedDynamicState3FeaturesEXT dynamicState3Features{};
+		dynamicState3Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_3_FEATURES_EXT;
+		dynamicState3Features.extendedDynamicState3ColorBlendEnable = VK_TRUE;
+		dynamicState3Features.extendedDynamicState3ColorWriteMask = VK_TRUE;
+		VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT libraryFeatures{};
+		libraryFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT;
+		libraryFeatures.graphicsPipelineLibrary = VK_TRUE;
+		if (pipelineFeatures.extendedDynamicState) {
+			dynamicStateFeatures.pNext = timelineFeatures.pNext;
+			timelineFeatures.pNext = &dynamicStateFeatures;
+		}
+		if (pipelineFeatures.extendedDynamicState2) {
+			dynamicState2Features.pNext = timelineFeatures.pNext;
+			timelineFeatures.pNext = &dynamicState2Features;
+		}
+		if (pipelineFeatures.dynamicBlend) {
+			dynamicState3Features.pNext = timelineFeatures.pNext;
+			timelineFeatures.pNext = &dynamicState3Features;
+		}
+		if (pipelineFeatures.graphicsPipelineLibrary) {
+			libraryFeatures.pNext = timelineFeatures.pNext;
+			timelineFeatures.pNext = &libraryFeatures;
+		}
 
 		VkDeviceCreateInfo createInfo{};
 		createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+		createInfo.pNext = &timelineFeatures;
 		createInfo.pQueueCreateInfos = queueCreateInfos.data();
 		createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 		createInfo.pEnabledFeatures = &deviceFeatures;
 
-		createInfo.enabledExtensionCount = static_cast<uint32_t>(requiredDeviceExtensions.size());
-		createInfo.ppEnabledExtensionNames = requiredDeviceExtensions.data();
+		// optional extensions are enabled when present and the features built on them switch off otherwise
+		std::vector<const char*> enabledExtensions;
+		if (presentsToSurface()) {
+			enabledExtensions = requiredDeviceExtensions;
+		}
+		bool memoryBudgetSupported = isDeviceExtensionSupported(physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+		if (memoryBudgetSupported) {
+			enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+		}
+		if (presentWaitEnabled) {
+			enabledExtensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+			enabledExtensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+		}
+		if (pipelineFeatures.extendedDynamicState) {
+			enabledExtensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+		}
+		if (pipelineFeatures.extendedDynamicState2) {
+			enabledExtensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_2_EXTENSION_NAME);
+		}
+		if (pipelineFeatures.dynamicBlend) {
+			enabledExtensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_3_EXTENSION_NAME);
+		}
+		if (pipelineFeatures.graphicsPipelineLibrary) {
+			enabledExtensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+			enabledExtensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+		}
+
+		createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+		createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
 		if (enableValidationLayers) {
 			createInfo.enabledLayerCount = static_cast<uint32_t>(validationLayers.size());
@@ -448,22 +1043,37 @@ private:
 			createInfo.enabledLayerCount = 0;
 		}
 
-		if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) != VK_SUCCESS) {
+		if (vkCreateDevice(physicalDevice, &createInfo, allocationCallbacks, &device) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create logical device!");
 		}
 
 		vkGetDeviceQueue(device, queueFamilyIndices.graphicsFamily.value(), 0, &graphicsQueue);
 		vkGetDeviceQueue(device, queueFamilyIndices.presentFamily.value(), 0, &presentQueue);
 		vkGetDeviceQueue(device, queueFamilyIndices.transferFamily.value(), 0, &transferQueue);
+
+		memoryAllocator.init(device, physicalDevice, memoryBudgetSupported);
+		presentPacer.init(device, presentWaitEnabled);
+		std::cout << "frame pacing: " << (presentWaitEnabled ? "present wait" : "GPU completion (no VK_KHR_present_wait)") << std::endl;
+		const MemoryTypeSelector& memoryTypes = memoryAllocator.getMemoryTypes();
+		std::cout << "pipelines: " << (pipelineFeatures.graphicsPipelineLibrary ? "linked from libraries" : "monolithic")
+			<< ", dynamic " << dynamicStateName(pipelineFeatures) << std::endl;
+		std::cout << "memory: " << (memoryTypes.isUnifiedMemory() ? "unified" : memoryTypes.hasResizableBar() ? "discrete with resizable BAR" : "discrete")
+			<< (memoryBudgetSupported ? ", budget from VK_EXT_memory_budget" : ", estimated budget") << std::endl;
 	}
 
-	void createSwapChain() {
+	void createSwapChain(VkSwapchainKHR oldSwapchain = VK_NULL_HANDLE) {
+		if (!presentsToSurface()) {
+			createOffscreenTarget();
+			return;
+		}
+
 		SwapChainSupportDetails swapChainDetails = querySwapChainSupport(physicalDevice, surface);
 
 		VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainDetails.formats);
 		VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainDetails.presentModes);
-		VkExtent2D extent = chooseSwapExtent(swapChainDetails.capabilities, m_window);
-		uint32_t imageCount = swapChainDetails.capabilities.minImageCount + 1;
+		VkExtent2D extent = chooseSwapExtent(swapChainDetails.capabilities, m_window, { WIDTH, HEIGHT });
+		uint32_t imageCount = options.swapchainImages > 0 ? options.swapchainImages : swapChainDetails.capabilities.minImageCount + frameProfile.extraSwapchainImages;
+		imageCount = std::max(imageCount, swapChainDetails.capabilities.minImageCount);
 		uint32_t maxImageCount = swapChainDetails.capabilities.maxImageCount;
 		if (maxImageCount > 0 && imageCount > maxImageCount) {
 			imageCount = maxImageCount;
@@ -497,9 +1107,9 @@ private:
 		//todo: see what happened in other mode
 		swapchainCreateInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 		swapchainCreateInfo.clipped = VK_TRUE;
-		swapchainCreateInfo.oldSwapchain = VK_NULL_HANDLE;
+		swapchainCreateInfo.oldSwapchain = oldSwapchain;
 
-		if (vkCreateSwapchainKHR(device, &swapchainCreateInfo, nullptr, &swapChain) != VK_SUCCESS) {
+		if (vkCreateSwapchainKHR(device, &swapchainCreateInfo, allocationCallbacks, &swapChain) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create swap chain!");
 		}
 
@@ -510,6 +1120,15 @@ private:
 		swapChainExtent = extent;
 	}
 
+	// sized like the swapchain would be, so frame profiles behave the same offscreen
+	void createOffscreenTarget() {
+		uint32_t imageCount = options.swapchainImages > 0 ? options.swapchainImages : frameProfile.framesInFlight + frameProfile.extraSwapchainImages;
+		offscreenTarget.init(device, physicalDevice, memoryAllocator, { WIDTH, HEIGHT }, imageCount, allocationCallbacks);
+		swapChainImages = offscreenTarget.getImages();
+		swapChainImageFormat = offscreenTarget.getFormat();
+		swapChainExtent = offscreenTarget.getExtent();
+	}
+
 	void createImageViews() {
 		swapChainImageViews.resize(swapChainImages.size());
 		for (size_t i = 0; i < swapChainImageViews.size();i++) {
@@ -528,7 +1147,7 @@ private:
 			imageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
 			imageViewCreateInfo.subresourceRange.layerCount = 1;
 
-			if (vkCreateImageView(device, &imageViewCreateInfo, nullptr, &swapChainImageViews[i]) != VK_SUCCESS) {
+			if (vkCreateImageView(device, &imageViewCreateInfo, allocationCallbacks, &swapChainImageViews[i]) != VK_SUCCESS) {
 				throw std::runtime_error("failed to create image views!");
 			}
 		}
@@ -537,7 +1156,7 @@ private:
 	void createDescriptionLayout() {
 		VkDescriptorSetLayoutBinding uboLayoutBinding{};
 		uboLayoutBinding.binding = 0;
-		uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
 		uboLayoutBinding.descriptorCount = 1;
 		uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 		uboLayoutBinding.pImmutableSamplers = nullptr;
@@ -546,156 +1165,88 @@ private:
 		layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
 		layoutInfo.bindingCount = 1;
 		layoutInfo.pBindings = &uboLayoutBinding;
-		if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
+		if (vkCreateDescriptorSetLayout(device, &layoutInfo, allocationCallbacks, &descriptorSetLayout) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create descriptor set layout!");
 		}
 	}
 
-	void createGraphicsPipeline() {
-		auto vertexShaderCode = ShaderUtils::readFile("./spv/trivert.spv");
-		auto fragShaderCode = ShaderUtils::readFile("./spv/trifrag.spv");
-
-		VkShaderModule vertShaderModule = ShaderUtils::createShaderModule(device, vertexShaderCode);
-		VkShaderModule fragShaderModule = ShaderUtils::createShaderModule(device, fragShaderCode);
-
-		VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-		vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-		vertShaderStageInfo.module = vertShaderModule;
-		vertShaderStageInfo.pName = "main";
-
-		VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-		fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-		fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-		fragShaderStageInfo.module = fragShaderModule;
-		fragShaderStageInfo.pName = "main";
-
-		VkPipelineShaderStageCreateInfo shaderStatges[] = { vertShaderStageInfo, fragShaderStageInfo };
-
-		std::vector<VkDynamicState> dynamicStates = {
-			VK_DYNAMIC_STATE_VIEWPORT,
-			VK_DYNAMIC_STATE_SCISSOR
-		};
-		VkPipelineDynamicStateCreateInfo dynamicState{};
-		dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-		dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
-		dynamicState.pDynamicStates = dynamicStates.data();
-
-		auto bindingDescription = Vertex::getBindingDescription();
-		auto attributeDescription = Vertex::getAttributeDescriptions();
-
-		VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-		vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-		vertexInputInfo.vertexBindingDescriptionCount = 1;
-		vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-		vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescription.size());
-		vertexInputInfo.pVertexAttributeDescriptions = attributeDescription.data();
-
-		VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-		inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-		inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-		inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-		VkViewport viewport{};
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		viewport.width = (float)swapChainExtent.width;
-		viewport.height = (float)swapChainExtent.height;
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
-
-		VkRect2D scissor{};
-		scissor.offset = { 0, 0 };
-		scissor.extent = swapChainExtent;
-
-		VkPipelineRasterizationStateCreateInfo rasterizer{};
-		rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-		rasterizer.depthClampEnable = VK_FALSE;
-		rasterizer.rasterizerDiscardEnable = VK_FALSE;
-		rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-		rasterizer.lineWidth = 1.0f;
-		rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-		rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
-		rasterizer.depthBiasEnable = VK_FALSE;
-		rasterizer.depthBiasConstantFactor = 0.0f;
-		rasterizer.depthBiasClamp = 0.0f;
-		rasterizer.depthBiasSlopeFactor = 0.0f;
-
-		VkPipelineViewportStateCreateInfo viewportState{};
-		viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-		viewportState.viewportCount = 1;
-		viewportState.pViewports = &viewport;
-		viewportState.scissorCount = 1;
-		viewportState.pScissors = &scissor;
-
-		VkPipelineMultisampleStateCreateInfo multisampling{};
-		multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-		multisampling.sampleShadingEnable = VK_FALSE;
-		multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-		multisampling.minSampleShading = 1.0f;
-		multisampling.pSampleMask = nullptr;
-		multisampling.alphaToCoverageEnable = VK_FALSE;
-		multisampling.alphaToOneEnable = VK_FALSE;
-
-		VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-		colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-		colorBlendAttachment.blendEnable = VK_FALSE;
-		colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
-		colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
-		colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-		colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-		colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-		colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-
-		VkPipelineColorBlendStateCreateInfo colorBlending{};
-		colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-		colorBlending.logicOpEnable = VK_FALSE;
-		colorBlending.logicOp = VK_LOGIC_OP_COPY;
-		colorBlending.attachmentCount = 1;
-		colorBlending.pAttachments = &colorBlendAttachment;
-		colorBlending.blendConstants[0] = 0.0f;
-		colorBlending.blendConstants[1] = 0.0f;
-		colorBlending.blendConstants[2] = 0.0f;
-		colorBlending.blendConstants[3] = 0.0f;
+	void createPipelineCache() {
+		pipelineCache.init(device, physicalDevice, options.pipelineCachePath, options.pipelineCacheReset, allocationCallbacks);
+		pipelineCompiler.init(jobs, device, pipelineCache.getHandle(), pipelineFeatures, allocationCallbacks);
+		pipelineRegistry.init(pipelineCompiler, device, allocationCallbacks);
+	}
 
+	void createGraphicsPipeline() {
 		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{};
 		pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
 		pipelineLayoutCreateInfo.setLayoutCount = 1;
 		pipelineLayoutCreateInfo.pSetLayouts = &descriptorSetLayout;
 		pipelineLayoutCreateInfo.pushConstantRangeCount = 0;
 		pipelineLayoutCreateInfo.pPushConstantRanges = nullptr;
-		if (vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout) != VK_SUCCESS) {
+		if (vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, allocationCallbacks, &pipelineLayout) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create pipeline layout");
 		}
 
-		VkGraphicsPipelineCreateInfo pipelineInfo{};
-		pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-		pipelineInfo.stageCount = 2;
-		pipelineInfo.pStages = shaderStatges;
-
-		pipelineInfo.pVertexInputState = &vertexInputInfo;
-		pipelineInfo.pInputAssemblyState = &inputAssembly;
-		pipelineInfo.pViewportState = &viewportState;
-		pipelineInfo.pRasterizationState = &rasterizer;
-		pipelineInfo.pMultisampleState = &multisampling;
-		pipelineInfo.pDepthStencilState = nullptr;
-		pipelineInfo.pColorBlendState = &colorBlending;
-		pipelineInfo.pDynamicState = &dynamicState;
-
-		pipelineInfo.layout = pipelineLayout;
+		// every material's pipeline starts compiling at once instead of on first use; unless draws wait for their
+		// pipelines, only the fallback has to be done before the first frame and the rest finish in the background
+		auto createStart = std::chrono::steady_clock::now();
+		fallbackDescription = fallbackPipelineDescription();
+		fallbackPipeline = pipelineRegistry.request(fallbackDescription);
+		for (const auto& material : MATERIALS) {
+			materialDescriptions.push_back(materialPipelineDescription(material));
+			materialPipelines.push_back(pipelineRegistry.request(materialDescriptions.back()));
+		}
+		pipelineRegistry.prefetch(fallbackPipeline);
+		for (PipelineId id : materialPipelines) {
+			pipelineRegistry.prefetch(id);
+		}
+		pipelineRegistry.get(fallbackPipeline);
+		if (options.pendingPipelines == PendingPipelinePolicy::Wait) {
+			for (PipelineId id : materialPipelines) {
+				pipelineRegistry.get(id);
+			}
+		}
+		pipelineCreateMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - createStart).count();
+		pipelineCache.markDirty();
+		PipelineRegistryStats pipelineStats = pipelineRegistry.getStats();
+		std::cout << MATERIALS.size() << " materials share " << pipelineStats.unique << " pipelines";
+		if (pipelineFeatures.graphicsPipelineLibrary) {
+			std::cout << ", linked from " << pipelineStats.libraries << " libraries";
+		}
+		std::cout << std::endl;
+	}
 
-		pipelineInfo.renderPass = renderPass;
-		pipelineInfo.subpass = 0;
+	// Deliberately not any material's state, so no material's pipeline is ready before the first frame just because
+	// it happens to be the fallback: opaque and without culling, so it shows every quad whatever its material. With
+	// extended dynamic state the cull mode is set while recording, and the registry shares the pipeline with the
+	// opaque materials.
+	PipelineDescription fallbackPipelineDescription() const {
+		PipelineDescription description = scenePipelineDescription();
+		description.cullMode = VK_CULL_MODE_NONE;
+		description.blendEnable = false;
+		return description;
+	}
 
-		pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-		pipelineInfo.basePipelineIndex = -1;
+	PipelineDescription materialPipelineDescription(const MaterialDescription& material) const {
+		PipelineDescription description = scenePipelineDescription();
+		description.blendEnable = material.blend;
+		return description;
+	}
 
-		if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS) {
-			throw std::runtime_error("failed to create graphics pipeline!");
-		}
+	uint32_t materialOf(uint32_t object) const {
+		return (object / gridSide) % static_cast<uint32_t>(MATERIALS.size());
+	}
 
-		vkDestroyShaderModule(device, fragShaderModule, nullptr);
-		vkDestroyShaderModule(device, vertShaderModule, nullptr);
+	PipelineDescription scenePipelineDescription() const {
+		PipelineDescription description;
+		description.vertexShader = "./spv/trivert.spv";
+		description.fragmentShader = "./spv/trifrag.spv";
+		description.vertexBinding = Vertex::getBindingDescription();
+		auto attributeDescriptions = Vertex::getAttributeDescriptions();
+		description.vertexAttributes.assign(attributeDescriptions.begin(), attributeDescriptions.end());
+		description.layout = pipelineLayout;
+		description.renderPass = renderPass;
+		return description;
 	}
 
 	void createRenderPass() {
@@ -707,7 +1258,7 @@ private:
 		colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 		colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 		colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-		colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+		colorAttachment.finalLayout = presentsToSurface() ? VK_IMAGE_LAYOUT_PRESENT_SRC_KHR : VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
 
 		VkAttachmentReference colorAttachmentRef{};
 		colorAttachmentRef.attachment = 0;
@@ -737,7 +1288,7 @@ private:
 		renderPassInfo.dependencyCount = 1;
 		renderPassInfo.pDependencies = &dependency;
 
-		if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS) {
+		if (vkCreateRenderPass(device, &renderPassInfo, allocationCallbacks, &renderPass) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create render pass");
 		}
 	}
@@ -756,7 +1307,7 @@ private:
 			framebufferInfo.height = swapChainExtent.height;
 			framebufferInfo.layers = 1;
 
-			if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapChainFrameBuffers[i]) != VK_SUCCESS) {
+			if (vkCreateFramebuffer(device, &framebufferInfo, allocationCallbacks, &swapChainFrameBuffers[i]) != VK_SUCCESS) {
 				throw std::runtime_error("failed to create framebuffer!");
 			}
 		}
@@ -765,111 +1316,171 @@ private:
 	void createCommandPool() {
 		QueueFamilyIndices queueFamilyIndices = findQueueFamliies(physicalDevice, surface);
 
-		VkCommandPoolCreateInfo poolInfo{};
-		poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-		poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-		poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily.value();
-		if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS) {
-			throw std::runtime_error("failed to create command pool!");
-		}
-
-		// secondary command pool
+		// graphics command buffers come from the recorder's per-frame pools
 		VkCommandPoolCreateInfo secondPoolInfo{};
 		secondPoolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 		secondPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 		secondPoolInfo.queueFamilyIndex = queueFamilyIndices.transferFamily.value();
-		if (vkCreateCommandPool(device, &secondPoolInfo, nullptr, &transferCommandPool) != VK_SUCCESS) {
+		if (vkCreateCommandPool(device, &secondPoolInfo, allocationCallbacks, &transferCommandPool) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create second command pool");
 		}
 	}
 
+	void createUploader() {
+		transferTimeline.create(device);
+		stagingRing.init(device, transferTimeline, memoryAllocator, STAGING_REGION_SIZE, STAGING_REGION_COUNT);
+		uploader.init(device, transferQueue, transferCommandPool, stagingRing, transferTimeline, queueFamilyIndices);
+	}
+
 	void createVertexBuffer() {
 		VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
-		VkBuffer tempBuffer;
-		VkDeviceMemory tempBufferMemory;
-		createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, tempBuffer, tempBufferMemory, queueFamilyIndices, device, physicalDevice);
-		void* data;
-		vkMapMemory(device, tempBufferMemory, 0, bufferSize, 0, &data);
-		{
-			memcpy(data, vertices.data(), (size_t)bufferSize);
-		}
-		vkUnmapMemory(device, tempBufferMemory);
-
-		createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory, queueFamilyIndices, device, physicalDevice);
-		copyBuffer(tempBuffer, vertexBuffer, bufferSize, transferCommandPool, transferQueue, device);
-
-		vkDestroyBuffer(device, tempBuffer, nullptr);
-		vkFreeMemory(device, tempBufferMemory, nullptr);
+		createGeometryBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertices.data(), memoryAllocator.getMemoryTypes().isUnifiedMemory(), vertexBuffer, vertexBufferAllocation, device, memoryAllocator, uploader);
 	}
 
 	void createIndexBuffer() {
 		VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
-		VkBuffer tempBuffer;
-		VkDeviceMemory tempBufferMemory;
-		createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, tempBuffer, tempBufferMemory, queueFamilyIndices, device, physicalDevice);
-		void* data;
-		vkMapMemory(device, tempBufferMemory, 0, bufferSize, 0, &data);
-		{
-			memcpy(data, indices.data(), (size_t)bufferSize);
-		}
-		vkUnmapMemory(device, tempBufferMemory);
-
-		createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory, queueFamilyIndices, device, physicalDevice);
-		copyBuffer(tempBuffer, indexBuffer, bufferSize, transferCommandPool, transferQueue, device);
-
-		vkDestroyBuffer(device, tempBuffer, nullptr);
-		vkFreeMemory(device, tempBufferMemory, nullptr);
+		createGeometryBuffer(bufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indices.data(), memoryAllocator.getMemoryTypes().isUnifiedMemory(), indexBuffer, indexBufferAllocation, device, memoryAllocator, uploader);
 	}
 
 	void createUniformBuffer() {
-		VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+		uniformRing.init(device, physicalDevice, memoryAllocator, uniformBytesPerFrame(), frameProfile.framesInFlight);
+	}
 
-		uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-		uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
-		uniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+	// room for every quad of the current scene at the largest alignment a device may require
+	VkDeviceSize uniformBytesPerFrame() const {
+		VkDeviceSize objectSize = alignUp(sizeof(UniformBufferObject), 256);
+		return std::max(UNIFORM_FRAME_SIZE, static_cast<VkDeviceSize>(scene.staticQuads + scene.dynamicQuads) * objectSize);
+	}
+
+	void createDescriptorPool() {
+		VkDescriptorPoolSize poolSize{};
+		poolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		poolSize.descriptorCount = UNIFORM_DESCRIPTOR_SETS;
+
+		VkDescriptorPoolCreateInfo poolInfo{};
+		poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+		poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+		poolInfo.poolSizeCount = 1;
+		poolInfo.pPoolSizes = &poolSize;
+		poolInfo.maxSets = UNIFORM_DESCRIPTOR_SETS;
+		if (vkCreateDescriptorPool(device, &poolInfo, allocationCallbacks, &descriptorPool) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create descriptor pool!");
+		}
+	}
 
-		for (int i = 0;i < MAX_FRAMES_IN_FLIGHT;i++) {
-			createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffers[i], uniformBuffersMemory[i], queueFamilyIndices, device, physicalDevice);
-			vkMapMemory(device, uniformBuffersMemory[i], 0, bufferSize, 0, &uniformBuffersMapped[i]);
+	// a single set for every frame and object, the dynamic offset picks the constants
+	void createDescriptorSet() {
+		VkDescriptorSetAllocateInfo allocInfo{};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorPool = descriptorPool;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &descriptorSetLayout;
+		if (vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate descriptor set!");
 		}
+		writeUniformDescriptor();
+	}
+
+	void writeUniformDescriptor() {
+		VkDescriptorBufferInfo bufferInfo{};
+		bufferInfo.buffer = uniformRing.getBuffer();
+		bufferInfo.offset = 0;
+		bufferInfo.range = sizeof(UniformBufferObject);
+
+		VkWriteDescriptorSet descriptorWrite{};
+		descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite.dstSet = descriptorSet;
+		descriptorWrite.dstBinding = 0;
+		descriptorWrite.dstArrayElement = 0;
+		descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+		descriptorWrite.descriptorCount = 1;
+		descriptorWrite.pBufferInfo = &bufferInfo;
+		vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
 	}
 	
 
 	void createCommandBuffers() {
-		commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-		VkCommandBufferAllocateInfo allocInfo{};
-		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-		allocInfo.commandPool = commandPool;
-		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-		allocInfo.commandBufferCount = (uint32_t)(commandBuffers.size());
+		recorder.init(jobs, device, queueFamilyIndices.graphicsFamily.value(), renderPass, frameProfile.framesInFlight,
+			options.perBufferReset, allocationCallbacks);
+		commandCache.init(frameProfile.framesInFlight);
+	}
 
-		if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS) {
-			throw std::runtime_error("failed to create command buffers!");
-		}
+	// only benchmarks read GPU times
+	void createGpuTimer() {
+		if (!options.frameBenchmark) return;
+		gpuTimer.init(device, physicalDevice, queueFamilyIndices.graphicsFamily.value(), frameProfile.framesInFlight, allocationCallbacks);
 	}
 
 	void createSyncObjects() {
-		imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-		renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-		inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+		createFrameSemaphores();
+		frameTimeline.create(device);
+	}
+
+	void createFrameSemaphores() {
+		imageAvailableSemaphores.resize(frameProfile.framesInFlight);
+		renderFinishedSemaphores.resize(frameProfile.framesInFlight);
 
 		VkSemaphoreCreateInfo semaphoreInfo{};
 		semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-		VkFenceCreateInfo fenceInfo{};
-		fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-		fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-		
-		for (size_t i = 0;i < MAX_FRAMES_IN_FLIGHT;i++) {
-			if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
-				vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
-				vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
+		// acquire and present only take binary semaphores, everything else is tracked on the timeline
+		for (size_t i = 0;i < frameProfile.framesInFlight;i++) {
+			if (vkCreateSemaphore(device, &semaphoreInfo, allocationCallbacks, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
+				vkCreateSemaphore(device, &semaphoreInfo, allocationCallbacks, &renderFinishedSemaphores[i]) != VK_SUCCESS) {
 				throw std::runtime_error("failed to create semaphores!");
 			}
 		}
 	}
 
-	void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+	void destroyFrameSemaphores() {
+		for (size_t i = 0;i < imageAvailableSemaphores.size();i++) {
+			vkDestroySemaphore(device, renderFinishedSemaphores[i], allocationCallbacks);
+			vkDestroySemaphore(device, imageAvailableSemaphores[i], allocationCallbacks);
+		}
+		imageAvailableSemaphores.clear();
+		renderFinishedSemaphores.clear();
+	}
+
+	// Rebuilds everything sized by the number of frames in flight, then the swapchain for the new image count.
+	// Profile switches are rare, so this simply drains the device.
+	void applyFrameProfile(const FrameProfile& profile) {
+		latency.report(std::cout, frameProfile.name);
+		latency.reset();
+
+		vkDeviceWaitIdle(device);
+		deletionQueue.collect(frameTimeline.lastSignaledValue());
+
+		destroyFrameSemaphores();
+		recorder.destroy();
+		uniformRing.destroy(memoryAllocator);
+
+		frameProfile = profile;
+		frameSlot = 0;
+		if (options.swapchainImages > 0) {
+			std::cout << "--swapchain-images " << options.swapchainImages << " overrides the image count of profile " << profile.name << std::endl;
+		}
+		createUniformBuffer();
+		writeUniformDescriptor();
+		createCommandBuffers();
+		createFrameSemaphores();
+		gpuTimer.destroy();
+		createGpuTimer();
+		recreateSwapChain();
+		std::cout << "frame profile " << frameProfile.name << ": " << frameProfile.framesInFlight << " frames in flight, "
+			<< swapChainImages.size() << " swapchain images" << std::endl;
+	}
+
+	// number of the frame being recorded
+	uint64_t currentFrameNumber() const {
+		return frameTimeline.lastSignaledValue() + 1;
+	}
+
+	// host wait until frame N has finished on the GPU
+	void waitForFrame(uint64_t frame) {
+		frameTimeline.wait(frame);
+	}
+
+	void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t currentFrame) {
 		VkCommandBufferBeginInfo beginInfo{};
 		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 		beginInfo.flags = 0;
@@ -879,6 +1490,9 @@ private:
 			throw std::runtime_error("failed to begin recording command buffer!");
 		}
 
+		gpuTimer.begin(commandBuffer, currentFrame);
+		uploader.recordAcquireBarriers(commandBuffer);
+
 		VkRenderPassBeginInfo renderPassInfo{};
 		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
 		renderPassInfo.renderPass = renderPass;
@@ -889,9 +1503,27 @@ private:
 		renderPassInfo.clearValueCount = 1;
 		renderPassInfo.pClearValues = &clearColor;
 
-		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+		std::vector<VkCommandBuffer> secondaries = recordStaticCommands(currentFrame);
+		std::vector<VkCommandBuffer> dynamicSecondaries = recorder.record(currentFrame, ParallelRecorder::DYNAMIC_CHANNEL,
+			static_cast<uint32_t>(visibleDynamicObjects.size()),
+			[this](VkCommandBuffer secondary, uint32_t firstDraw, uint32_t drawCount) {
+				recordSceneDraws(secondary, visibleDynamicObjects.data() + firstDraw, drawCount);
+			});
+		secondaries.insert(secondaries.end(), dynamicSecondaries.begin(), dynamicSecondaries.end());
+		if (!secondaries.empty()) {
+			vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+		}
+
+		vkCmdEndRenderPass(commandBuffer);
+		gpuTimer.end(commandBuffer, currentFrame);
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to record command buffer!");
+		}
+	}
 
-		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+	// Secondaries don't inherit any state from the primary, so each one sets up everything it draws with.
+	void recordSceneDraws(VkCommandBuffer commandBuffer, const uint32_t* objects, uint32_t objectCount) {
 		VkViewport viewport{};
 		viewport.y = viewport.x = 0.0f;
 		viewport.minDepth = 0.0f;
@@ -912,25 +1544,184 @@ private:
 		vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT16);
 
 		//vkCmdDraw(commandBuffer, static_cast<uint32_t>(vertices.size()), 1, 0, 0);
-		vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+		// objects come in index order, so the material only changes from one grid row to the next
+		uint32_t boundMaterial = UINT32_MAX;
+		bool pending = false;
+		uint64_t pendingDraws = 0;
+		for (uint32_t i = 0; i < objectCount; i++) {
+			uint32_t material = materialOf(objects[i]);
+			if (material != boundMaterial) {
+				VkPipeline pipeline = bindablePipeline(materialPipelines[material], pending);
+				if (pipeline != VK_NULL_HANDLE) {
+					vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+					pipelineCompiler.setDynamicState(commandBuffer, pending ? fallbackDescription : materialDescriptions[material]);
+				}
+				boundMaterial = material;
+			}
+			if (pending) {
+				pendingDraws++;
+				if (options.pendingPipelines == PendingPipelinePolicy::Skip) continue;
+			}
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 1, &objectUniformOffsets[objects[i]]);
+			vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
+		}
+		pendingPipelineDraws += pendingDraws;
+	}
 
-		vkCmdEndRenderPass(commandBuffer);
-		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-			throw std::runtime_error("failed to record command buffer!");
+	// The pipeline to draw with. One that is still compiling never blocks the recording unless the policy says
+	// so: the fallback stands in for it, or VK_NULL_HANDLE when its draws are skipped. Once it is done, the
+	// registry's version changes and cached static commands are recorded again with the real one.
+	VkPipeline bindablePipeline(PipelineId id, bool& pending) {
+		if (options.pendingPipelines == PendingPipelinePolicy::Wait) {
+			pending = false;
+			return pipelineRegistry.get(id);
 		}
+		VkPipeline pipeline = pipelineRegistry.tryGet(id);
+		pending = pipeline == VK_NULL_HANDLE;
+		if (!pending) return pipeline;
+		return options.pendingPipelines == PendingPipelinePolicy::Fallback ? pipelineRegistry.get(fallbackPipeline) : VK_NULL_HANDLE;
 	}
 
-	void updateUniformBuffer(uint32_t currentFrame) {
+	// Looked up before culling: static quads only depend on where the scene puts them, the fixed camera and the
+	// aspect ratio, so the key covers what is visible as well and a hit means they need not be culled again.
+	void lookupStaticCommands(uint32_t currentFrame) {
+		staticCommandKey.sceneVersion = sceneVersion;
+		staticCommandKey.extent = swapChainExtent;
+		staticCommandKey.pipelineVersion = pipelineRegistry.getVersion();
+		staticCommandKey.uniformBase = objectUniformOffsets.empty() ? 0 : objectUniformOffsets[0];
+		staticCommandsCached = options.commandCache && commandCache.lookupStatic(currentFrame, staticCommandKey, cachedStaticCommands);
+	}
+
+	// Without the cache, or after a miss, the static draws are recorded again on the job system.
+	std::vector<VkCommandBuffer> recordStaticCommands(uint32_t currentFrame) {
+		if (staticCommandsCached) {
+			return cachedStaticCommands;
+		}
+		std::vector<VkCommandBuffer> commandBuffers = recorder.record(currentFrame, ParallelRecorder::STATIC_CHANNEL,
+			static_cast<uint32_t>(visibleStaticObjects.size()),
+			[this](VkCommandBuffer secondary, uint32_t firstDraw, uint32_t drawCount) {
+				recordSceneDraws(secondary, visibleStaticObjects.data() + firstDraw, drawCount);
+			});
+		commandCache.storeStatic(currentFrame, staticCommandKey, commandBuffers);
+		return commandBuffers;
+	}
+
+	// benchmarks step the animation by a fixed 1/60 s per frame so every run renders the same frames
+	float animationTime(uint64_t frame) {
+		if (options.frameBenchmark) {
+			return frame / 60.0f;
+		}
 		static auto startTime = std::chrono::high_resolution_clock::now();
+		return std::chrono::duration<float>(std::chrono::high_resolution_clock::now() - startTime).count();
 	}
 
-	void drawFrame() {
-		static uint32_t currentFrame = 0;
+	// Main thread part of the scene update: how many quads are drawn and where their constants go. The constants
+	// themselves are written by writeObjectUniforms on the job system while the frame is recorded.
+	void prepareFrameScene(uint32_t currentFrame, uint64_t frame) {
+		cameraView = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+		cameraProj = glm::perspective(glm::radians(45.0f), swapChainExtent.width / (float)swapChainExtent.height, 0.1f, 10.0f);
+		cameraProj[1][1] *= -1;
+
+		uniformRing.beginFrame(currentFrame);
+		// static quads come first, so they get the same offsets every time this slot comes round
+		dynamicQuadCount = scene.dynamicQuads > 0 ? static_cast<uint32_t>(frame % (scene.dynamicQuads + 1)) : 0;
+		uint32_t quadCount = scene.staticQuads + dynamicQuadCount;
+		gridSide = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(scene.staticQuads + scene.dynamicQuads))));
+		UniformAllocation objects = uniformRing.allocateArray(sizeof(UniformBufferObject), quadCount, objectUniformStride);
+		objectUniforms = static_cast<char*>(objects.mapped);
+		objectUniformOffsets.resize(quadCount);
+		for (uint32_t i = 0; i < quadCount; i++) {
+			objectUniformOffsets[i] = objects.dynamicOffset + static_cast<uint32_t>(i * objectUniformStride);
+		}
+	}
+
+	// a single quad keeps the original transform, more are laid out on a grid across the same area
+	glm::mat4 quadPlacement(uint32_t object) const {
+		glm::mat4 placement(1.0f);
+		if (gridSide > 1) {
+			float cellSize = 2.0f / gridSide;
+			glm::vec3 cellCenter((object % gridSide + 0.5f) * cellSize - 1.0f, (object / gridSide + 0.5f) * cellSize - 1.0f, 0.0f);
+			placement = glm::scale(glm::translate(placement, cellCenter), glm::vec3(cellSize * 0.8f));
+		}
+		return placement;
+	}
+
+	void writeObjectUniforms(float time) {
+		jobs.parallelFor(static_cast<uint32_t>(objectUniformOffsets.size()), OBJECTS_PER_JOB, [this, time](uint32_t begin, uint32_t end) {
+			UniformBufferObject ubo{};
+			ubo.view = cameraView;
+			ubo.proj = cameraProj;
+			for (uint32_t i = begin; i < end; i++) {
+				ubo.model = glm::rotate(quadPlacement(i), (time + i * 0.01f) * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+				memcpy(objectUniforms + i * objectUniformStride, &ubo, sizeof(ubo));
+			}
+		});
+	}
+
+	// Tests each quad's bounding sphere against the view frustum. Quads only spin around their centre, so the
+	// sphere through the corners of the unrotated placement bounds them at any time. Static quads are skipped
+	// when their cached commands are reused, since those already draw exactly the visible ones.
+	void cullScene(bool cullStatic) {
+		Frustum frustum = Frustum::fromMatrix(cameraProj * cameraView);
+		uint32_t quadCount = static_cast<uint32_t>(objectUniformOffsets.size());
+		uint32_t firstQuad = cullStatic ? 0 : std::min(scene.staticQuads, quadCount);
+		objectVisible.resize(quadCount);
+		jobs.parallelFor(quadCount - firstQuad, OBJECTS_PER_JOB, [this, &frustum, firstQuad](uint32_t begin, uint32_t end) {
+			for (uint32_t i = firstQuad + begin; i < firstQuad + end; i++) {
+				glm::mat4 placement = quadPlacement(i);
+				float radius = glm::length(glm::vec3(placement * glm::vec4(0.5f, 0.5f, 0.0f, 0.0f)));
+				objectVisible[i] = frustum.intersectsSphere(glm::vec3(placement[3]), radius) ? 1 : 0;
+			}
+		});
+
+		if (cullStatic) {
+			visibleStaticObjects.clear();
+		}
+		visibleDynamicObjects.clear();
+		for (uint32_t i = firstQuad; i < quadCount; i++) {
+			if (!objectVisible[i]) continue;
+			(i < scene.staticQuads ? visibleStaticObjects : visibleDynamicObjects).push_back(i);
+		}
+	}
 
-		vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+	void drawFrame() {
+		auto frameStart = std::chrono::steady_clock::now();
+		if (pendingProfile >= 0) {
+			applyFrameProfile(FRAME_PROFILES[pendingProfile]);
+			pendingProfile = -1;
+		}
+		if (pendingScene >= 0) {
+			scene = SCENES[pendingScene];
+			sceneVersion++;
+			pendingScene = -1;
+			if (uniformBytesPerFrame() > uniformRing.getFrameCapacity()) {
+				growUniformRing();
+			}
+			std::cout << "scene " << scene.name << ": " << scene.staticQuads << " static, " << scene.dynamicQuads << " dynamic quads" << std::endl;
+		}
+		uint32_t currentFrame = frameSlot;
+
+		// this slot was last used framesInFlight frames ago, and frames retire in order
+		uint64_t frame = currentFrameNumber();
+		uint64_t retiredFrame = frame > frameProfile.framesInFlight ? frame - frameProfile.framesInFlight : 0;
+		bool retiredDisplayed = presentPacer.waitUntilDisplayed(swapChain, retiredFrame, frameTimeline);
+		waitForFrame(retiredFrame);
+		double gpuMs;
+		if (gpuTimer.read(currentFrame, gpuMs)) {
+			frameBenchmark.onGpuTime(retiredFrame, gpuMs);
+		}
+		auto workStart = std::chrono::steady_clock::now();
+		deletionQueue.collect(retiredFrame);
+		frameTimes.onFrame();
+		if (latency.hasFramesInFlight()) {
+			latency.onFrameComplete(frameTimeline.completedValue());
+			latency.onFrameRetired(retiredFrame, retiredDisplayed);
+		}
 
 		uint32_t imageIndex;
-		VkResult res = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+		auto acquireStart = std::chrono::steady_clock::now();
+		VkResult res = acquireImage(imageAvailableSemaphores[currentFrame], imageIndex);
+		auto acquireEnd = std::chrono::steady_clock::now();
 		if (res == VK_ERROR_OUT_OF_DATE_KHR) {
 			framebufferResized = false;
 			recreateSwapChain();
@@ -940,33 +1731,129 @@ private:
 			throw std::runtime_error("failed to acquire swap chain image");
 		}
 
-		vkResetCommandBuffer(commandBuffers[currentFrame], 0);
-		recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+		latency.onFrameStart(frame);
+		presentPacer.onFrameStart(frame);
+		float time = animationTime(frame);
+		prepareFrameScene(currentFrame, frame);
+		pipelineRegistry.beginFrame(frame);
+
+		// the slot's last frame is complete, so everything it recorded can be recycled
+		recorder.beginFrame(currentFrame);
+		lookupStaticCommands(currentFrame);
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		double recordMs = 0.0;
+		JobHandle uploads = jobs.submit([this]() { uploader.endFrame(); });
+		JobHandle uniforms = jobs.submit([this, time]() { writeObjectUniforms(time); });
+		JobHandle culling = jobs.submit([this]() { cullScene(!staticCommandsCached); });
+		// recording only needs the constants' offsets, so it overlaps with writing them; the primary takes the
+		// acquire barriers of this frame's uploads
+		JobHandle recording = jobs.submit([&]() {
+			auto recordStart = std::chrono::steady_clock::now();
+			commandBuffer = recorder.allocatePrimary(currentFrame);
+			recordCommandBuffer(commandBuffer, imageIndex, currentFrame);
+			recordMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - recordStart).count();
+		}, { uploads, culling });
+		jobs.wait({ uploads, uniforms, culling, recording });
 
 		VkSubmitInfo submitInfo{};
 		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-		VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame]};
-		VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-		submitInfo.waitSemaphoreCount = 1;
-		submitInfo.pWaitSemaphores = waitSemaphores;
-		submitInfo.pWaitDstStageMask = waitStages;
+		// geometry uploads are waited for on the GPU; waiting on the latest ticket covers all earlier ones
+		VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame], transferTimeline.handle() };
+		VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, UPLOAD_CONSUMER_STAGES };
+		uint64_t waitValues[] = { 0, uploader.lastSubmittedTicket().value };
+		VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame], frameTimeline.handle() };
+		uint64_t signalValues[] = { 0, frameTimeline.nextValue() };
+		// offscreen frames are neither acquired nor presented, so only the timelines take part
+		uint32_t skip = presentsToSurface() ? 0 : 1;
+		VkTimelineSemaphoreSubmitInfo timelineInfo{};
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+		timelineInfo.waitSemaphoreValueCount = 2 - skip;
+		timelineInfo.pWaitSemaphoreValues = waitValues + skip;
+		timelineInfo.signalSemaphoreValueCount = 2 - skip;
+		timelineInfo.pSignalSemaphoreValues = signalValues + skip;
+		submitInfo.pNext = &timelineInfo;
+		submitInfo.waitSemaphoreCount = 2 - skip;
+		submitInfo.pWaitSemaphores = waitSemaphores + skip;
+		submitInfo.pWaitDstStageMask = waitStages + skip;
 		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
-		VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
-		submitInfo.signalSemaphoreCount = 1;
-		submitInfo.pSignalSemaphores = signalSemaphores;
-
-		vkResetFences(device, 1, &inFlightFences[currentFrame]);
+		submitInfo.pCommandBuffers = &commandBuffer;
+		submitInfo.signalSemaphoreCount = 2 - skip;
+		submitInfo.pSignalSemaphores = signalSemaphores + skip;
 
-		if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
+		if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS) {
 			throw std::runtime_error("failed to submit draw command buffer!");
 		}
 
+		auto presentStart = std::chrono::steady_clock::now();
+		res = presentImage(imageIndex, renderFinishedSemaphores[currentFrame], frame);
+		latency.onPresentCall(frame);
+		if (res == VK_ERROR_OUT_OF_DATE_KHR || res == VK_SUBOPTIMAL_KHR || framebufferResized) {
+			framebufferResized = false;
+			recreateSwapChain();
+		}
+		else if (res != VK_SUCCESS) {
+			throw std::runtime_error("failed to present swap chain image!");
+		}
+
+		frameSlot = (frameSlot + 1) % frameProfile.framesInFlight;
+
+		// acquire and present may block on the display, so they are left out of the CPU time
+		double cpuMs = std::chrono::duration<double, std::milli>(acquireStart - workStart).count()
+			+ std::chrono::duration<double, std::milli>(presentStart - acquireEnd).count();
+		frameBenchmark.onFrame(frame, std::chrono::duration<double, std::milli>(frameStart - lastFrameStart).count(), cpuMs, recordMs);
+		lastFrameStart = frameStart;
+	}
+
+	void writeFrameBenchmark() {
+		VkPhysicalDeviceProperties deviceProperties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &deviceProperties);
+		const char* target = !options.headless ? "window" : presentsToSurface() ? "headless surface" : "offscreen";
+		frameBenchmark.writeJson(options.benchmarkOutput, {
+			{ "scene", FrameBenchmark::quote(scene.name) },
+			{ "staticDraws", std::to_string(scene.staticQuads) },
+			{ "dynamicDraws", std::to_string(scene.dynamicQuads) },
+			{ "commandCache", options.commandCache ? "true" : "false" },
+			{ "workerThreads", std::to_string(jobs.getThreadCount()) },
+			{ "backgroundThreads", std::to_string(jobs.getBackgroundThreadCount()) },
+			{ "commandBufferReset", FrameBenchmark::quote(options.perBufferReset ? "per buffer" : "per frame pool") },
+			{ "device", FrameBenchmark::quote(deviceProperties.deviceName) },
+			{ "target", FrameBenchmark::quote(target) },
+			{ "extent", FrameBenchmark::quote(std::to_string(swapChainExtent.width) + "x" + std::to_string(swapChainExtent.height)) },
+			{ "profile", FrameBenchmark::quote(frameProfile.name) },
+			{ "framesInFlight", std::to_string(frameProfile.framesInFlight) },
+			{ "images", std::to_string(swapChainImages.size()) },
+			{ "validation", enableValidationLayers ? "true" : "false" },
+			{ "gpuTimestamps", gpuTimer.isSupported() ? "true" : "false" },
+			{ "materials", std::to_string(MATERIALS.size()) },
+			{ "pipelines", std::to_string(pipelineRegistry.getStats().unique) },
+			{ "pipelineLibraries", pipelineFeatures.graphicsPipelineLibrary ? std::to_string(pipelineRegistry.getStats().libraries) : "null" },
+			{ "dynamicState", FrameBenchmark::quote(dynamicStateName(pipelineFeatures)) },
+			{ "pipelineCache", FrameBenchmark::quote(PipelineCacheFile::describe(pipelineCache.getLoadResult())) },
+			{ "pipelineCreateMs", std::to_string(pipelineCreateMs) },
+			{ "pendingPipelines", FrameBenchmark::quote(pendingPipelinePolicyName(options.pendingPipelines)) },
+			{ "pipelineHitchesAvoided", std::to_string(pipelineRegistry.getStats().hitchesAvoided) },
+			{ "pipelineFallbackFrames", std::to_string(pipelineRegistry.getStats().fallbackFrames) },
+			{ "startupMs", std::to_string(startupMs) },
+		});
+		std::cout << "frame benchmark written to " << options.benchmarkOutput << std::endl;
+	}
+
+	VkResult acquireImage(VkSemaphore imageAvailable, uint32_t& imageIndex) {
+		if (!presentsToSurface()) {
+			imageIndex = offscreenTarget.acquire();
+			return VK_SUCCESS;
+		}
+		return vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailable, VK_NULL_HANDLE, &imageIndex);
+	}
+
+	VkResult presentImage(uint32_t imageIndex, VkSemaphore renderFinished, uint64_t frame) {
+		if (!presentsToSurface()) return VK_SUCCESS;
+
 		VkPresentInfoKHR presentInfo{};
 		presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 		presentInfo.waitSemaphoreCount = 1;
-		presentInfo.pWaitSemaphores = signalSemaphores;
+		presentInfo.pWaitSemaphores = &renderFinished;
 
 		VkSwapchainKHR swapChains[] = { swapChain };
 		presentInfo.swapchainCount = 1;
@@ -974,56 +1861,141 @@ private:
 		presentInfo.pImageIndices = &imageIndex;
 		presentInfo.pResults = nullptr;
 
+		VkPresentIdKHR presentId{};
+		presentId.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+		presentId.swapchainCount = 1;
+		presentId.pPresentIds = &frame;
+		if (presentWaitEnabled) {
+			presentInfo.pNext = &presentId;
+		}
+		return vkQueuePresentKHR(presentQueue, &presentInfo);
+	}
 
-		vkQueuePresentKHR(presentQueue, &presentInfo);
+	// Frees a buffer once every frame that could still read it has finished, without waiting for the device.
+	// Copies into it that are still queued are dropped; those already submitted are done by then as well, since
+	// every frame's submit waits for the uploader's latest ticket.
+	void destroyBufferDeferred(VkBuffer& buffer, MemoryAllocation& allocation) {
+		uploader.cancel(buffer);
+		deletionQueue.push(currentFrameNumber(), [this, buffer, allocation]() mutable {
+			destroyBuffer(buffer, allocation, device, memoryAllocator);
+		});
+		buffer = VK_NULL_HANDLE;
+		allocation = MemoryAllocation{};
+	}
 
-		currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+	// A scene with more quads than the ring holds gets a bigger one, and a descriptor set pointing at it. The old
+	// buffer and set may still be read by frames in flight, so they go to the deletion queue instead of waiting
+	// for the device.
+	void growUniformRing() {
+		VkBuffer oldBuffer;
+		MemoryAllocation oldAllocation;
+		uniformRing.release(oldBuffer, oldAllocation);
+		destroyBufferDeferred(oldBuffer, oldAllocation);
+		VkDescriptorSet oldDescriptorSet = descriptorSet;
+		deletionQueue.push(currentFrameNumber(), [this, oldDescriptorSet]() {
+			vkFreeDescriptorSets(device, descriptorPool, 1, &oldDescriptorSet);
+		});
+		createUniformBuffer();
+		createDescriptorSet();
 	}
 
 	void recreateSwapChain() {
 		int width = 0, height = 0;
-		glfwGetFramebufferSize(m_window, &width, &height);
-		while (width == 0 || height == 0) {
+		while (m_window && (width == 0 || height == 0)) {
 			glfwGetFramebufferSize(m_window, &width, &height);
 			glfwPollEvents();
 		}
 
-		vkDeviceWaitIdle(device);
-
-		cleanupSwapChain();
-
-		createSwapChain();
+		frameTimes.onSwapchainRecreated();
+		// offscreen images have no oldSwapchain hand-over, they are only rebuilt for profile switches
+		if (options.resizeWaitIdle || !presentsToSurface()) {
+			vkDeviceWaitIdle(device);
+			cleanupSwapChain();
+			createSwapChain();
+		}
+		else {
+			retireSwapChain();
+		}
 		createImageViews();
 		createFramebuffers();
+		presentPacer.onSwapchainRecreated(currentFrameNumber());
+	}
+
+	// Hands the current swapchain to its replacement as oldSwapchain and queues the old handles for
+	// destruction, so frames already in flight keep rendering and presenting into them. They are freed
+	// once every frame recorded so far has completed, plus a frame-in-flight window of slack for
+	// presentation, which the frame timeline does not cover.
+	void retireSwapChain() {
+		VkSwapchainKHR oldSwapChain = swapChain;
+		std::vector<VkFramebuffer> oldFramebuffers = std::move(swapChainFrameBuffers);
+		std::vector<VkImageView> oldImageViews = std::move(swapChainImageViews);
+		swapChainFrameBuffers.clear();
+		swapChainImageViews.clear();
+
+		createSwapChain(oldSwapChain);
+
+		deletionQueue.push(frameTimeline.lastSignaledValue() + frameProfile.framesInFlight, [this, oldSwapChain, oldFramebuffers, oldImageViews]() {
+			for (auto framebuffer : oldFramebuffers) {
+				vkDestroyFramebuffer(device, framebuffer, allocationCallbacks);
+			}
+			for (auto imageView : oldImageViews) {
+				vkDestroyImageView(device, imageView, allocationCallbacks);
+			}
+			vkDestroySwapchainKHR(device, oldSwapChain, allocationCallbacks);
+		});
 	}
 
 	void cleanupSwapChain() {
 		for (auto framebuffer : swapChainFrameBuffers) {
-			vkDestroyFramebuffer(device, framebuffer, nullptr);
+			vkDestroyFramebuffer(device, framebuffer, allocationCallbacks);
 		}
 		for (auto imageView : swapChainImageViews) {
-			vkDestroyImageView(device, imageView, nullptr);
+			vkDestroyImageView(device, imageView, allocationCallbacks);
+		}
+		if (presentsToSurface()) {
+			vkDestroySwapchainKHR(device, swapChain, allocationCallbacks);
+		}
+		else {
+			offscreenTarget.destroy(memoryAllocator);
 		}
-		vkDestroySwapchainKHR(device, swapChain, nullptr);
 	}
 
-	static void framebufferResizeCallback(GLFWwindow* window, int width, int height) {
+	static void framebufferResizeCallback(GLFWwindow* window, int, int) {
 		auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
 		app->framebufferResized = true;
 	}
-};
 
+	static void keyCallback(GLFWwindow* window, int key, int, int action, int) {
+		auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
+		app->latency.onInput();
+		if (action == GLFW_PRESS && key >= GLFW_KEY_1 && key < GLFW_KEY_1 + static_cast<int>(FRAME_PROFILES.size())) {
+			app->pendingProfile = key - GLFW_KEY_1;
+		}
+		if (action == GLFW_PRESS && key == GLFW_KEY_S) {
+			size_t current = 0;
+			while (current < SCENES.size() && SCENES[current].name != app->scene.name) current++;
+			app->pendingScene = static_cast<int>((current + 1) % SCENES.size());
+		}
+	}
+
+	static void cursorPosCallback(GLFWwindow* window, double, double) {
+		auto app = reinterpret_cast<HelloTriangleApplication*>(glfwGetWindowUserPointer(window));
+		app->latency.onInput();
+	}
+};
 
-int main() {
-	HelloTriangleApplication app;
 
+int main(int argc, char* argv[]) {
+	int exitCode = EXIT_SUCCESS;
 	try {
+		HelloTriangleApplication app(parseAppOptions(argc, argv));
 		app.run();
+		exitCode = app.getExitCode();
 	}
 	catch (const std::exception& e) {
 		std::cerr << e.what() << std::endl;
 		return EXIT_FAILURE;
 	}
 
-	return EXIT_SUCCESS;
+	return exitCode;
 }
\ No newline at end of file